@@ -0,0 +1,258 @@
+// Host microbenchmark of refracting the environment through windows, comparing sampling an equirectangular map (highp, with the trigonometry to get from direction to texture coordinates) against sampling a cubemap (mediump, by direction directly).
+// This runs on whatever GLES 3.1 implementation EGL gives us without a display (e.g. Mesa's llvmpipe), so it only says anything about shader cost on that implementation.
+// How the two compare on device is what decides which one we use, which is what 'scripts/bench_env.sh device' measures.
+//
+// The shaders here are cut down from the refraction variant of the window shader in src/desktop.c, and must be kept in sync with it.
+//
+// Usage: sh scripts/bench_env.sh host [resolution, default 1024] [draws, default 20]
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl31.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ENV_X_RES 1024
+#define ENV_Y_RES 512
+#define ENV_LEVELS 7
+#define ENV_FACE_RES (ENV_X_RES / 4)
+#define ENV_LOD 3.0
+
+#define WIN_RES 512
+
+// Fullscreen triangle, with a view direction and normal which vary across it like they would across a curved window.
+
+static char const* const VERT_SRC =
+	"#version 310 es\n"
+	"out vec3 view_dir;\n"
+	"out vec3 world_normal;\n"
+	"out vec2 tex_coord;\n"
+	"void main() {\n"
+	"	vec2 pos = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);\n"
+	"	view_dir = vec3(pos * 0.8, -1.0);\n"
+	"	world_normal = normalize(vec3(pos.yx * 0.3, 1.0));\n"
+	"	tex_coord = pos * 0.5 + 0.5;\n"
+	"	gl_Position = vec4(pos, 0.0, 1.0);\n"
+	"}\n";
+
+static char const* const EQUIRECT_FRAG_SRC =
+	"#version 310 es\n"
+	"precision highp float;\n"
+	"in vec3 view_dir;\n"
+	"in vec3 world_normal;\n"
+	"in vec2 tex_coord;\n"
+	"uniform sampler2D env;\n"
+	"uniform sampler2D win_tex;\n"
+	"uniform float env_lod;\n"
+	"out vec4 frag_colour;\n"
+	"const float PI = 3.14159265359;\n"
+	"vec2 dir_to_equirect(vec3 dir) {\n"
+	"	float lon = atan(dir.z, dir.x) + PI / 2.0;\n"
+	"	float lat = asin(clamp(dir.y, -1.0, 1.0));\n"
+	"	return vec2(lon / (2.0 * PI) + 0.5, lat / PI + 0.5);\n"
+	"}\n"
+	"void main() {\n"
+	"	vec4 win_colour = texture(win_tex, tex_coord);\n"
+	"	vec3 R = refract(normalize(view_dir), normalize(world_normal), 1.0 / 1.333);\n"
+	"	vec3 colour = textureLod(env, dir_to_equirect(normalize(R)), env_lod).rgb;\n"
+	"	frag_colour = vec4(win_colour.bgr + colour * (1.0 - win_colour.a), 1.0);\n"
+	"}\n";
+
+static char const* const CUBEMAP_FRAG_SRC =
+	"#version 310 es\n"
+	"precision mediump float;\n"
+	"in vec3 view_dir;\n"
+	"in vec3 world_normal;\n"
+	"in vec2 tex_coord;\n"
+	"uniform samplerCube env;\n"
+	"uniform sampler2D win_tex;\n"
+	"uniform float env_lod;\n"
+	"out vec4 frag_colour;\n"
+	"void main() {\n"
+	"	vec4 win_colour = texture(win_tex, tex_coord);\n"
+	"	vec3 R = refract(normalize(view_dir), normalize(world_normal), 1.0 / 1.333);\n"
+	"	vec3 colour = textureLod(env, R, env_lod).rgb;\n"
+	"	frag_colour = vec4(win_colour.bgr + colour * (1.0 - win_colour.a), 1.0);\n"
+	"}\n";
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static GLuint create_program(char const* frag_src) {
+	GLuint const program = glCreateProgram();
+
+	char const* const srcs[] = {VERT_SRC, frag_src};
+	GLenum const types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+
+	for (size_t i = 0; i < 2; i++) {
+		GLuint const shader = glCreateShader(types[i]);
+
+		glShaderSource(shader, 1, &srcs[i], NULL);
+		glCompileShader(shader);
+
+		GLint ok;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+
+		if (!ok) {
+			char log[1024];
+			glGetShaderInfoLog(shader, sizeof log, NULL, log);
+			fprintf(stderr, "Failed to compile shader: %s\n", log);
+
+			exit(1);
+		}
+
+		glAttachShader(program, shader);
+	}
+
+	glLinkProgram(program);
+	return program;
+}
+
+// Create a texture filled with noise (if given), so that sampling it can't be optimized away.
+// Windows are half translucent, so that the environment actually shows through them.
+
+static GLuint create_tex(GLenum target, GLsizei levels, GLsizei x_res, GLsizei y_res, unsigned char* noise, GLenum min_filter) {
+	GLuint tex;
+
+	glGenTextures(1, &tex);
+	glBindTexture(target, tex);
+	glTexStorage2D(target, levels, GL_RGBA8, x_res, y_res);
+
+	if (noise == NULL) {
+		return tex;
+	}
+
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		for (int face = 0; face < 6; face++) {
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, x_res, y_res, GL_RGBA, GL_UNSIGNED_BYTE, noise);
+		}
+	}
+
+	else {
+		glTexSubImage2D(target, 0, 0, 0, x_res, y_res, GL_RGBA, GL_UNSIGNED_BYTE, noise);
+	}
+
+	if (levels > 1) {
+		glGenerateMipmap(target);
+	}
+
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, min_filter);
+	return tex;
+}
+
+int main(int argc, char** argv) {
+	int const res = argc > 1 ? atoi(argv[1]) : 1024;
+	int const draws = argc > 2 ? atoi(argv[2]) : 20;
+
+	// Set up a context without a display.
+
+	PFNEGLGETPLATFORMDISPLAYEXTPROC const get_platform_display = (void*) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (get_platform_display == NULL) {
+		fprintf(stderr, "EGL_EXT_platform_base isn't supported.\n");
+		return 1;
+	}
+
+	EGLDisplay const display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+	if (!eglInitialize(display, NULL, NULL)) {
+		fprintf(stderr, "Couldn't initialize EGL.\n");
+		return 1;
+	}
+
+	eglBindAPI(EGL_OPENGL_ES_API);
+
+	EGLint const context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE};
+	EGLContext const context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "Couldn't make GLES 3.1 context current.\n");
+		return 1;
+	}
+
+	printf("Renderer: %s\n", glGetString(GL_RENDERER));
+
+	// Create textures.
+
+	unsigned char* const noise = malloc(ENV_X_RES * ENV_Y_RES * 4);
+
+	for (size_t i = 0; i < ENV_X_RES * ENV_Y_RES * 4; i++) {
+		noise[i] = rand();
+	}
+
+	GLuint const equirect = create_tex(GL_TEXTURE_2D, ENV_LEVELS, ENV_X_RES, ENV_Y_RES, noise, GL_LINEAR_MIPMAP_LINEAR);
+	GLuint const cubemap = create_tex(GL_TEXTURE_CUBE_MAP, ENV_LEVELS, ENV_FACE_RES, ENV_FACE_RES, noise, GL_LINEAR_MIPMAP_LINEAR);
+
+	for (size_t i = 0; i < WIN_RES * WIN_RES; i++) {
+		noise[i * 4 + 3] = 128;
+	}
+
+	GLuint const win = create_tex(GL_TEXTURE_2D, 1, WIN_RES, WIN_RES, noise, GL_LINEAR);
+	GLuint const target = create_tex(GL_TEXTURE_2D, 1, res, res, NULL, GL_LINEAR);
+
+	free(noise);
+
+	GLuint fbo, vao;
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+	glViewport(0, 0, res, res);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	// Time each variant.
+	// Everything is run a few times over and only the last run is reported, so that each has had the chance to warm up.
+
+	struct {
+		char const* name;
+		GLenum target;
+		GLuint env;
+		GLuint program;
+	} const variants[] = {
+		{"equirect (highp, atan/asin)", GL_TEXTURE_2D, equirect, create_program(EQUIRECT_FRAG_SRC)},
+		{"cubemap (mediump)", GL_TEXTURE_CUBE_MAP, cubemap, create_program(CUBEMAP_FRAG_SRC)},
+	};
+
+	size_t const variant_count = sizeof variants / sizeof *variants;
+
+	for (int run = 0; run < 3; run++) {
+		for (size_t i = 0; i < variant_count; i++) {
+			glUseProgram(variants[i].program);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(variants[i].target, variants[i].env);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, win);
+
+			glUniform1i(glGetUniformLocation(variants[i].program, "env"), 0);
+			glUniform1i(glGetUniformLocation(variants[i].program, "win_tex"), 1);
+			glUniform1f(glGetUniformLocation(variants[i].program, "env_lod"), ENV_LOD);
+
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			glFinish();
+
+			double const start = now();
+
+			for (int j = 0; j < draws; j++) {
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			}
+
+			glFinish();
+			double const dt = (now() - start) / draws;
+
+			if (run == 2) {
+				printf("%-30s %.3f ms/frame, %.2f ns/fragment\n", variants[i].name, dt * 1e3, dt * 1e9 / ((double) res * res));
+			}
+		}
+	}
+
+	return 0;
+}
@@ -58,11 +58,22 @@ cp assets/lib/libvdriver_loader.so .out/apk_stage/lib/arm64-v8a
 
 echo "Build objs."
 
+# Set MIST_DEBUG_ALLOCS=1 to count heap allocations made on the render thread (see src/alloc_debug.h).
+# This works by having the linker redirect our calls to malloc & co.
+
+debug_flags=
+debug_ldflags=
+
+if [ "$MIST_DEBUG_ALLOCS" = 1 ]; then
+	debug_flags="-DMIST_DEBUG_ALLOCS"
+	debug_ldflags="-Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc"
+fi
+
 objs=
 
-for src in gvd env shader win desktop platform; do
+for src in gvd env asset ktx2 shader pane win desktop platform swapchain gpu_timer res_gov arena alloc_debug gl_state ubo_ring render_pass frame_pacer quality_gov; do
 	$CC \
-		-Wall \
+		-Wall $debug_flags \
 		-I$NATIVE_APP_GLUE_PATH -I$OPENXR_SDK/build/include -Isrc/glad/include -Iassets/include \
 		--sysroot=$TOOLCHAIN_PATH/sysroot \
 		-fPIC \
@@ -78,7 +89,7 @@ fi
 objs="$objs .out/glad.o"
 
 $CXX \
-	-Wall \
+	-Wall $debug_flags \
 	-I$NATIVE_APP_GLUE_PATH -I$OPENXR_SDK/build/include -Isrc/glad/include \
 	--sysroot=$TOOLCHAIN_PATH/sysroot \
 	-fPIC \
@@ -91,7 +102,7 @@ echo "Link."
 
 $CXX \
 	-I $NATIVE_APP_GLUE_PATH -L.out/apk_stage/lib/$ABI -shared \
-	$objs -o .out/apk_stage/lib/$ABI/libmain.so \
+	$objs -o .out/apk_stage/lib/$ABI/libmain.so $debug_ldflags \
 	-llog -lopenxr_loader -landroid -lEGL -lgv_agent .out/native_app_glue.o
 
 echo "Generate the APK."
@@ -110,8 +121,9 @@ fi
 
 # This LD_PRELOAD exists for when running on FreeBSD.
 # TODO I think we can drastically speed up AAPT2 by modifying an existing APK instead of creating a new one each time.
+# Images are stored uncompressed (they're compressed already anyway), so that they can be mmap'd straight from the APK (see src/asset.h).
 
-LD_PRELOAD=$BUILD_TOOLS_PATH/lib64/libc++.so $AAPT package -f \
+LD_PRELOAD=$BUILD_TOOLS_PATH/lib64/libc++.so $AAPT package -f -0 png -0 ktx2 \
 	-M AndroidManifest.xml -I $PLATFORM_PATH/android.jar -A assets \
 	-F .out/Mist.apk .out/apk_stage
 
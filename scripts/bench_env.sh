@@ -0,0 +1,71 @@
+#!/bin/sh
+set -e
+
+# Compare refracting the environment as an equirectangular map against as a cubemap (see debug.mist.env_cubemap).
+#
+# 'host' runs a microbenchmark of just the two refraction shaders on the host's GLES implementation (see bench/env_refraction.c).
+# 'device' runs Mist on a connected headset once with each, and averages the GPU time of the projection layer (as measured with gpu_timer_t and logged by the desktop) over a while in each.
+# For that to mean anything, have the same windows in view for both runs, and keep your head still.
+#
+# Usage: sh scripts/bench_env.sh host [resolution] [draws]
+#        sh scripts/bench_env.sh device [seconds per run, default 30]
+
+usage() {
+	echo "Usage: $0 host [resolution] [draws]" >&2
+	echo "       $0 device [seconds per run]" >&2
+	exit 1
+}
+
+if [ $# -lt 1 ]; then
+	usage
+fi
+
+MODE=$1
+shift
+
+if [ "$MODE" = host ]; then
+	CC=${CC:-cc}
+
+	mkdir -p .out/bench
+	$CC -std=gnu17 -Wall -O2 bench/env_refraction.c -o .out/bench/env_refraction -lEGL -lGLESv2
+	.out/bench/env_refraction "$@"
+
+	exit
+fi
+
+if [ "$MODE" != device ]; then
+	usage
+fi
+
+DURATION=${1:-30}
+WARMUP=10
+
+# Refraction has to be drawn into the projection layer for there to be anything to compare.
+
+adb shell setprop debug.mist.refraction 1
+adb shell setprop debug.mist.win_layers 0
+
+for cubemap in 0 1; do
+	adb shell setprop debug.mist.env_cubemap $cubemap
+
+	adb shell am force-stop com.inobulles.mist
+	adb shell am start -n com.inobulles.mist/android.app.NativeActivity > /dev/null
+
+	# Let the environment load and the resolution governor settle before measuring.
+
+	sleep $WARMUP
+	adb logcat -c
+	sleep $DURATION
+
+	adb logcat -d -s mist-log:I |
+		grep -o "GPU time: [0-9.]* ms, render scale: [0-9.]*" |
+		awk -v cubemap=$cubemap '
+			{ gpu += $3; scale += $6; n++ }
+			END {
+				if (n == 0) { print "No GPU times logged with debug.mist.env_cubemap=" cubemap "."; exit 1 }
+				printf "%-10s %.3f ms GPU time, %.2f render scale (%d samples)\n", cubemap ? "cubemap" : "equirect", gpu / n, scale / n, n
+			}'
+done
+
+adb shell am force-stop com.inobulles.mist
+adb shell setprop debug.mist.env_cubemap 0
@@ -0,0 +1,38 @@
+#!/bin/sh
+set -e
+
+# Convert an environment's equirectangular map to an ASTC-compressed KTX2 texture with a full mip chain, which mist_env_create prefers over the PNG.
+# This is uploaded to the GPU as it is, so it's much faster to load and takes 4-8x less memory than a decoded PNG.
+# Once converted, the PNG can be removed from the environment so it isn't shipped in the APK.
+#
+# This needs ImageMagick and the 'ktx' tool from KTX-Software (https://github.com/KhronosGroup/KTX-Software).
+# ETC2 KTX2 textures are read too, but 'ktx' can only encode ASTC (which every headset we target supports anyway).
+#
+# Usage: sh scripts/env_to_ktx2.sh <env name> [ASTC block size, default 6x6]
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 <env name> [ASTC block size]" >&2
+	exit 1
+fi
+
+ENV=assets/envs/$1
+BLOCK=${2:-6x6}
+
+if [ ! -f $ENV/equirectangle.png ]; then
+	echo "$ENV/equirectangle.png doesn't exist." >&2
+	exit 1
+fi
+
+# Images are uploaded bottom row first, which is also what PNGs are flipped to when decoded.
+# Compressed blocks can't be flipped at load time, so flip before compressing.
+
+tmp=$(mktemp --suffix .png)
+magick $ENV/equirectangle.png -flip $tmp
+
+ktx create \
+	--format ASTC_${BLOCK}_UNORM_BLOCK \
+	--astc-quality thorough \
+	--generate-mipmap \
+	$tmp $ENV/equirectangle.ktx2
+
+rm $tmp
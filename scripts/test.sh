@@ -0,0 +1,21 @@
+#!/bin/sh
+set -e
+
+# Build and run the host-side tests in tests/.
+# Each test is a single file along with the sources it tests (which must not need GL, OpenXR, or Android), named after the source it tests.
+#
+# Usage: sh scripts/test.sh
+
+CC=${CC:-cc}
+
+mkdir -p .out/tests
+
+for test in tests/*.c; do
+	name=$(basename $test .c)
+
+	$CC -std=gnu17 -Wall -Werror -Isrc $test src/$name.c -o .out/tests/$name -lm
+	echo "Running $name."
+	.out/tests/$name
+done
+
+echo "All tests passed!"
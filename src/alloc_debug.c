@@ -0,0 +1,46 @@
+#include "alloc_debug.h"
+#include "log.h"
+
+#if defined(MIST_DEBUG_ALLOCS)
+
+#include <stdint.h>
+
+// These are what the linker redirects calls to when passed '-Wl,--wrap=malloc' etc.
+// The '__real_*' functions are the actual libc ones.
+// Only calls from our own objects are redirected, so this doesn't count allocations made inside other libraries (including libc++).
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static _Thread_local size_t alloc_count = 0;
+static _Thread_local size_t frame_count = 0;
+
+void* __wrap_malloc(size_t size) {
+	alloc_count++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	alloc_count++;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+	alloc_count++;
+	return __real_realloc(ptr, size);
+}
+
+void alloc_debug_frame(void) {
+	if (frame_count < ALLOC_DEBUG_WARMUP_FRAMES) {
+		frame_count++;
+	}
+
+	else if (alloc_count > 0) {
+		LOGW("%zu heap allocations on the render thread this frame.", alloc_count);
+	}
+
+	alloc_count = 0;
+}
+
+#endif
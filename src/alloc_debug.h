@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+// Number of frames after startup before we consider the frame loop to be in a steady state.
+// Allocations before that are expected (e.g. creating windows and their swapchains).
+
+#define ALLOC_DEBUG_WARMUP_FRAMES 120
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// When built with MIST_DEBUG_ALLOCS (see build.sh), all calls to malloc, calloc and realloc from our own code are counted per thread.
+// The render thread calls this at the end of each frame, which flags any heap allocations it made during the frame once in the steady state.
+// Otherwise, this does nothing.
+
+#if defined(MIST_DEBUG_ALLOCS)
+void alloc_debug_frame(void);
+#else
+static inline void alloc_debug_frame(void) {}
+#endif
+
+#if defined(__cplusplus)
+}
+#endif
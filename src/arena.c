@@ -0,0 +1,41 @@
+#include "arena.h"
+#include "log.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+void arena_create(arena_t* arena, size_t size) {
+	arena->buf = malloc(size);
+	assert(arena->buf != NULL);
+
+	arena->size = size;
+	arena->used = 0;
+}
+
+void arena_destroy(arena_t* arena) {
+	free(arena->buf);
+}
+
+void arena_reset(arena_t* arena) {
+	arena->used = 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t count, size_t size) {
+	// Align everything as malloc would, so we never have to think about it.
+
+	size_t const align = alignof(max_align_t);
+	size_t const start = (arena->used + align - 1) & ~(align - 1);
+
+	if (start > arena->size || (size != 0 && count > (arena->size - start) / size)) {
+		LOGE("Frame arena full (%zu bytes), couldn't allocate %zu more.", arena->size, count * size);
+		return NULL;
+	}
+
+	void* const ptr = arena->buf + start;
+	memset(ptr, 0, count * size);
+
+	arena->used = start + count * size;
+	return ptr;
+}
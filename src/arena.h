@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Arena for transient data which only lives for a single frame.
+// Everything in it is freed at once by resetting it at the start of the next frame, so allocating from it is just bumping a pointer.
+
+typedef struct {
+	uint8_t* buf;
+	size_t size;
+	size_t used;
+} arena_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+void arena_create(arena_t* arena, size_t size);
+void arena_destroy(arena_t* arena);
+void arena_reset(arena_t* arena);
+
+// Allocate zeroed memory for 'count' elements of 'size' bytes, like calloc.
+// Returns NULL if the arena is full.
+
+void* arena_alloc(arena_t* arena, size_t count, size_t size);
+
+#if defined(__cplusplus)
+}
+#endif
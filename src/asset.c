@@ -0,0 +1,84 @@
+#include "asset.h"
+#include "log.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int asset_map(asset_map_t* map, AAssetManager* mgr, char const* path) {
+	map->data = NULL;
+	map->size = 0;
+	map->map = NULL;
+	map->map_size = 0;
+
+	map->asset = AAssetManager_open(mgr, path, AASSET_MODE_BUFFER);
+
+	if (map->asset == NULL) {
+		return -1;
+	}
+
+	// Uncompressed assets can be opened as a file descriptor to the APK itself, at some offset into it.
+	// mmap offsets have to be page-aligned, so map from the start of the page the asset starts in.
+
+	off_t start;
+	off_t len;
+	int const fd = AAsset_openFileDescriptor(map->asset, &start, &len);
+
+	if (fd >= 0) {
+		off_t const page_size = sysconf(_SC_PAGESIZE);
+		off_t const aligned_start = start & ~(page_size - 1);
+
+		map->map_size = len + (start - aligned_start);
+		map->map = mmap(NULL, map->map_size, PROT_READ, MAP_PRIVATE, fd, aligned_start);
+
+		// The mapping keeps the file open by itself.
+
+		close(fd);
+
+		if (map->map != MAP_FAILED) {
+			AAsset_close(map->asset);
+			map->asset = NULL;
+
+			// We're about to read all of it, so start reading it in now.
+
+			madvise(map->map, map->map_size, MADV_WILLNEED);
+
+			map->data = (uint8_t*) map->map + (start - aligned_start);
+			map->size = len;
+
+			return 0;
+		}
+
+		LOGW("Failed to mmap %s, falling back to its buffer.", path);
+		map->map = NULL;
+		map->map_size = 0;
+	}
+
+	map->data = AAsset_getBuffer(map->asset);
+
+	if (map->data == NULL) {
+		LOGE("Could not get buffer for %s.", path);
+
+		AAsset_close(map->asset);
+		map->asset = NULL;
+
+		return -1;
+	}
+
+	map->size = AAsset_getLength(map->asset);
+	return 0;
+}
+
+void asset_unmap(asset_map_t* map) {
+	if (map->map != NULL) {
+		munmap(map->map, map->map_size);
+		map->map = NULL;
+	}
+
+	if (map->asset != NULL) {
+		AAsset_close(map->asset);
+		map->asset = NULL;
+	}
+
+	map->data = NULL;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <android_native_app_glue.h>
+
+// An asset mapped into memory, so that it can be read without copying it.
+// Assets which are stored uncompressed in the APK (which is how build.sh packages images) are mmap'd straight from it.
+// Others have to be inflated by the asset manager, in which case we're stuck with its buffer.
+
+typedef struct {
+	void const* data;
+	size_t size;
+
+	// Either the mapping we made ourselves (and its size), or the asset whose buffer we're using.
+
+	void* map;
+	size_t map_size;
+
+	AAsset* asset;
+} asset_map_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Returns -1 without logging anything if the asset doesn't exist, as that's expected for optional ones.
+
+int asset_map(asset_map_t* map, AAssetManager* mgr, char const* path);
+void asset_unmap(asset_map_t* map);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+// Current time on the monotonic clock, in nanoseconds.
+// This is only for measuring how long things take on the CPU, so unlike XrTime, it doesn't need converting to and from the runtime's clock.
+
+static inline uint64_t clock_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -1,11 +1,101 @@
 #include "desktop.h"
+#include "clock.h"
+#include "frustum.h"
+#include "gl_state.h"
 #include "log.h"
 #include "matrix.h"
+#include "render_pass.h"
 #include "shader.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Number of views the multiview shader renders to.
+// This has to be known when compiling it.
+
+#define MULTIVIEW_VIEW_COUNT 2
+
+// Uniform block bindings.
+// The 'frame' block has everything which is the same for the whole frame (per view), and the 'win' block everything specific to the window being drawn.
+
+#define FRAME_UBO_BINDING 0
+#define WIN_UBO_BINDING 1
+
+// Texture unit the blurred environment map is bound to for refraction.
+// Whatever's drawn on the panes goes on PANE_TEX_UNIT.
+
+#define ENV_TEX_UNIT 0
+
+// Roughness of the glass windows are made of, which selects how blurred the environment looks through them (see mist_env_t).
+
+#define WIN_ROUGHNESS 0.5
+
+// Near and far clipping planes.
+// These are also passed on to the compositor along with depth.
+
+#define NEAR_Z 0.1
+#define FAR_Z 500
+
+// What the quality governor's levers do when pulled (see quality_gov.h).
+// The LOD error scale is how much further away windows are considered to be when picking their LOD level, and the upload interval is the number of frames between uploads for windows we're not looking at.
+
+#define QUALITY_MIP_BIAS 2
+#define QUALITY_LOD_ERROR_SCALE 2
+#define QUALITY_UPLOAD_INTERVAL 4
+
+// How often to log statistics, in nanoseconds.
+
+#define STATS_INTERVAL 1000000000
+
+// Layouts of the uniform blocks (std140).
+// Without multiview, each pass only ever reads the first view of the 'frame' block, so there's a copy of it for each pass with that pass's view first.
+
+typedef struct {
+	matrix_t view[MULTIVIEW_VIEW_COUNT];
+	matrix_t proj[MULTIVIEW_VIEW_COUNT];
+	float camera_pos[MULTIVIEW_VIEW_COUNT][4];
+} frame_ubo_t;
+
+typedef struct {
+	matrix_t model;
+} win_ubo_t;
+
+// Render passes.
+// Nothing is ever loaded from memory at the start of a pass: the projection layer is cleared and window copies overwrite everything.
+// With on-tile MSAA, the multisampled buffer is resolved into the colour attachment and never leaves the tile itself, so storing the colour attachment is all there is to write back.
+
+static render_pass_t const PROJECTION_PASS = {
+	.name = "projection",
+	.attachment_count = 1,
+	.attachments = {
+		{GL_COLOR_ATTACHMENT0, RENDER_PASS_CLEAR, RENDER_PASS_STORE},
+	},
+	.clear_colour = {0, 0, 0, 0},
+};
+
+// Same as above, but with depth for the compositor to reproject with.
+
+static render_pass_t const PROJECTION_DEPTH_PASS = {
+	.name = "projection (with depth)",
+	.attachment_count = 2,
+	.attachments = {
+		{GL_COLOR_ATTACHMENT0, RENDER_PASS_CLEAR, RENDER_PASS_STORE},
+		{ GL_DEPTH_ATTACHMENT, RENDER_PASS_CLEAR, RENDER_PASS_STORE},
+	},
+	.clear_colour = {0, 0, 0, 0},
+	.clear_depth = 1,
+};
+
+static render_pass_t const COPY_PASS = {
+	.name = "window copy",
+	.attachment_count = 1,
+	.attachments = {
+		{GL_COLOR_ATTACHMENT0, RENDER_PASS_DONT_CARE, RENDER_PASS_STORE},
+	},
+};
 
 #define MULTILINE(...) #__VA_ARGS__
 #pragma clang diagnostic ignored "-Wunknown-escape-sequence"
@@ -15,246 +105,1240 @@ static char const* const WIN_SHADER_VERT_SRC = MULTILINE(
 \#version 310 es\n
 precision highp float;
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec2 tex_coord;
-layout(location = 2) in vec3 normal;
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 tex_coord;
+layout(location = 2) in vec3 normal;
+
+layout(std140) uniform frame {
+	mat4 view[2];
+	mat4 proj[2];
+	vec4 camera_pos[2];
+};
+
+layout(std140) uniform win {
+	mat4 model;
+};
+
+\n\#ifdef REFRACTION\n
+out vec3 view_dir;
+out vec3 world_normal;
+\n\#endif\n
+out vec2 interp_tex_coord;
+
+void main() {
+	vec4 world_pos_4 = model * vec4(pos, 1.0);
+\n\#ifdef REFRACTION\n
+	view_dir = world_pos_4.xyz - camera_pos[0].xyz;
+	world_normal = mat3(model) * normal;
+\n\#endif\n
+	interp_tex_coord = tex_coord;
+
+	gl_Position = proj[0] * view[0] * world_pos_4;
+}
+);
+
+// Same as the above, but renders to both views at once with GL_OVR_multiview2.
+
+static char const* const WIN_SHADER_VERT_MULTIVIEW_SRC = MULTILINE(
+\#version 310 es\n
+\#extension GL_OVR_multiview2 : require\n
+precision highp float;
+
+layout(num_views = 2) in;
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 tex_coord;
+layout(location = 2) in vec3 normal;
+
+layout(std140) uniform frame {
+	mat4 view[2];
+	mat4 proj[2];
+	vec4 camera_pos[2];
+};
+
+layout(std140) uniform win {
+	mat4 model;
+};
+
+\n\#ifdef REFRACTION\n
+out vec3 view_dir;
+out vec3 world_normal;
+\n\#endif\n
+out vec2 interp_tex_coord;
+
+void main() {
+	vec4 world_pos_4 = model * vec4(pos, 1.0);
+\n\#ifdef REFRACTION\n
+	view_dir = world_pos_4.xyz - camera_pos[gl_ViewID_OVR].xyz;
+	world_normal = mat3(model) * normal;
+\n\#endif\n
+	interp_tex_coord = tex_coord;
+
+	gl_Position = proj[gl_ViewID_OVR] * view[gl_ViewID_OVR] * world_pos_4;
+}
+);
+
+// Window shader variants are specialized with these features:
+// - TRANSLUCENT: The window has translucent parts, so its alpha has to be taken into account.
+// - REFRACTION: Refract the environment through the translucent parts of the window, rather than leaving it to the compositor to blend the window over the environment layer.
+// - ENV_CUBEMAP: Along with REFRACTION, the environment is a cubemap sampled by the refracted direction directly, rather than an equirectangular map (see mist_env_opts_t).
+// The equirectangular maths needs highp floats to not fall apart near the poles, but everything else is just colours, for which mediump is plenty.
+
+static char const* const WIN_SHADER_FRAG_SRC = MULTILINE(
+\#version 310 es\n
+\n\#if defined(REFRACTION) && !defined(ENV_CUBEMAP)\n
+precision highp float;
+\n\#else\n
+precision mediump float;
+\n\#endif\n
+
+\n\#ifdef REFRACTION\n
+in vec3 view_dir;
+in vec3 world_normal;
+
+uniform float env_lod;
+\n\#endif\n
+
+\n\#if defined(REFRACTION) && defined(ENV_CUBEMAP)\n
+uniform samplerCube env;
+\n\#elif defined(REFRACTION)\n
+uniform sampler2D env;
+
+const float PI = 3.14159265359;
+
+vec2 dir_to_equirect(vec3 dir) {
+	float lon = atan(dir.z, dir.x) + PI / 2.0;
+	float lat = asin(clamp(dir.y, -1.0, 1.0));
+	return vec2(lon / (2.0 * PI) + 0.5, lat / PI + 0.5);
+}
+\n\#endif\n
+
+in vec2 interp_tex_coord;
+
+uniform sampler2D win_tex;
+
+out vec4 frag_colour;
+
+void main() {
+	vec4 win_colour = texture(win_tex, interp_tex_coord);
+
+\n\#if !defined(TRANSLUCENT)\n
+	frag_colour = vec4(win_colour.bgr, 1.0);
+\n\#elif !defined(REFRACTION)\n
+	/* Window contents are premultiplied already, so the compositor can blend them over the environment layer as they are. */
+	frag_colour = win_colour.bgra;
+\n\#else\n
+	vec3 N = normalize(world_normal);
+	vec3 V = normalize(view_dir);
+
+	/* TODO Fresnel? */
+
+	vec3 R = refract(V, N, 1.0 / 1.333 /* water */);
+
+\n\#ifdef ENV_CUBEMAP\n
+	vec3 colour = textureLod(env, R, env_lod).rgb;
+\n\#else\n
+	vec3 colour = textureLod(env, dir_to_equirect(normalize(R)), env_lod).rgb;
+\n\#endif\n
+
+	/* Window contents are premultiplied, so they can be blended over the environment as they are. */
+	frag_colour = vec4(win_colour.bgr + colour * (1.0 - win_colour.a), 1.0);
+\n\#endif\n
+}
+);
+
+// Features each variant of the window shader is built with.
+// There's room for one more than any of them has, for ENV_CUBEMAP.
+
+#define WIN_MAX_DEFINES 3
+
+static struct {
+	char const* name;
+	size_t define_count;
+	char const* defines[WIN_MAX_DEFINES - 1];
+} const WIN_VARIANTS[WIN_VARIANT_COUNT] = {
+	[WIN_VARIANT_OPAQUE] = {"opaque", 0, {}},
+	[WIN_VARIANT_TRANSLUCENT] = {"translucent", 1, {"TRANSLUCENT"}},
+	[WIN_VARIANT_REFRACTION] = {"refraction", 2, {"TRANSLUCENT", "REFRACTION"}},
+};
+
+// Copies window contents to their swapchain with a single fullscreen triangle, generated from the vertex ID so no buffers are needed.
+// Window contents are BGRA and top-down, so they're swizzled and flipped on the way.
+
+static char const* const COPY_SHADER_VERT_SRC = MULTILINE(
+\#version 310 es\n
+precision highp float;
+
+out vec2 tex_coord;
+
+void main() {
+	vec2 pos = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+	tex_coord = vec2(pos.x + 1.0, 1.0 - pos.y) / 2.0;
+	gl_Position = vec4(pos, 0.0, 1.0);
+}
+);
+
+static char const* const COPY_SHADER_FRAG_SRC = MULTILINE(
+\#version 310 es\n
+precision highp float;
+
+in vec2 tex_coord;
+
+uniform sampler2D win_tex;
+
+out vec4 frag_colour;
+
+void main() {
+	frag_colour = texture(win_tex, tex_coord).bgra;
+}
+);
+// clang-format on
+
+static desktop_t* global_desktop = NULL;
+
+// Attach a swapchain image to the currently bound FBO, taking multiview and MSAA into account.
+
+static void attach_image(desktop_t* d, GLenum attachment, GLuint image) {
+	if (d->multiview && d->msaa_samples > 1) {
+		glFramebufferTextureMultisampleMultiviewOVR(GL_DRAW_FRAMEBUFFER, attachment, image, 0, d->msaa_samples, 0, d->view_count);
+	}
+
+	else if (d->multiview) {
+		glFramebufferTextureMultiviewOVR(GL_DRAW_FRAMEBUFFER, attachment, image, 0, 0, d->view_count);
+	}
+
+	else if (d->msaa_samples > 1) {
+		glFramebufferTexture2DMultisampleEXT(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, image, 0, d->msaa_samples);
+	}
+
+	else {
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, image, 0);
+	}
+}
+
+int desktop_create(
+	desktop_t* d,
+	XrSession sesh,
+	size_t view_count,
+	XrViewConfigurationView* views,
+	mist_env_t* env,
+	desktop_opts_t const* opts
+) {
+	// TODO Maybe the desktop should be responsible for the environment too?
+
+	d->sesh = sesh;
+	d->env = env;
+	d->opts = *opts;
+	d->win_count = 0;
+	d->wins = NULL;
+	d->view_count = view_count;
+	d->last_display_time = 0;
+	d->last_stats_time = 0;
+	d->frame_start_time = 0;
+	d->pose_time = 0;
+	d->display_period = 0;
+	d->frame_index = 0;
+	d->focused_win = 0;
+	d->frame_ubo_offsets = NULL;
+	memset(d->win_shaders, 0, sizeof d->win_shaders);
+	memset(d->win_shader_submitted, 0, sizeof d->win_shader_submitted);
+	d->copy_shader_submitted = false;
+	d->shaders_ready = false;
+	d->shaders_failed = false;
+	d->copy_shader = 0;
+	d->clear_tex = 0;
+	d->swapchain_count = 0;
+	d->swapchains = NULL;
+	d->depth_swapchains = NULL;
+	d->depth_infos = NULL;
+	d->layer_views = NULL;
+	d->win_layer_count = 0;
+	d->win_layer_cap = 0;
+	d->win_layers = NULL;
+	d->overflow_win_count = 0;
+	d->layers = NULL;
+	pthread_mutex_init(&d->win_mutex, NULL);
+
+	LOGI(
+		"Submitting windows as %s.",
+		!d->opts.win_layers     ? "part of the projection layer" :
+		d->opts.cylinder_layers ? "cylinder layers" :
+										  "quad layers"
+	);
+
+	if (d->opts.win_layers) {
+		LOGI("Up to %zu windows can be their own layers, any more are part of the projection layer.", d->opts.max_win_layers);
+	}
+
+	// Check if we can render all views in a single pass with multiview.
+	// This needs all views to be the same size, as they'll be layers of the same array texture.
+
+	d->multiview = false;
+
+	if (GLAD_GL_OVR_multiview2 && view_count == MULTIVIEW_VIEW_COUNT) {
+		GLint max_views = 0;
+		glGetIntegerv(GL_MAX_VIEWS_OVR, &max_views);
+
+		d->multiview = max_views >= MULTIVIEW_VIEW_COUNT;
+
+		for (size_t i = 1; i < view_count; i++) {
+			if (
+				views[i].recommendedImageRectWidth != views[0].recommendedImageRectWidth ||
+				views[i].recommendedImageRectHeight != views[0].recommendedImageRectHeight
+			) {
+				d->multiview = false;
+			}
+		}
+	}
+
+	LOGI("%s multiview.", d->multiview ? "Using" : "Not using");
+
+	// Start creating shaders now that we know which ones we need.
+	// The driver compiles them in the background while we get on with everything else, and we only wait on them once we need to render (see shaders_finish).
+	// Even with window layers, windows past the layer limit are drawn into the projection layer, so we need all the variants either way.
+
+	d->shaders_start = clock_now();
+
+	for (size_t i = 0; i < WIN_VARIANT_COUNT; i++) {
+		d->win_shader_submitted[i] = !(!d->opts.refraction && i == WIN_VARIANT_REFRACTION);
+
+		if (!d->win_shader_submitted[i]) {
+			continue;
+		}
+
+		// Refraction also depends on what kind of map the environment is.
+
+		char const* defines[WIN_MAX_DEFINES];
+		size_t define_count = WIN_VARIANTS[i].define_count;
+
+		memcpy(defines, WIN_VARIANTS[i].defines, define_count * sizeof *defines);
+
+		if (i == WIN_VARIANT_REFRACTION && d->opts.env_cubemap) {
+			defines[define_count++] = "ENV_CUBEMAP";
+		}
+
+		shader_submit(
+			&d->win_shader_jobs[i],
+			d->multiview ? WIN_SHADER_VERT_MULTIVIEW_SRC : WIN_SHADER_VERT_SRC,
+			WIN_SHADER_FRAG_SRC,
+			define_count,
+			defines
+		);
+	}
+
+	if (d->opts.win_layers) {
+		shader_submit(&d->copy_shader_job, COPY_SHADER_VERT_SRC, COPY_SHADER_FRAG_SRC, 0, NULL);
+		d->copy_shader_submitted = true;
+	}
+
+	// Create GPU timer and resolution governor.
+
+	gpu_timer_create(&d->gpu_timer);
+	res_gov_init(&d->res_gov);
+
+	// Create uniform buffer ring.
+	// There's a 'frame' block per pass, i.e. per swapchain.
+
+	ubo_ring_create(&d->ubo_ring);
+
+	// Work out how we're doing MSAA.
+	// Swapchain images are always single-sampled, and we render to them through a multisampled buffer which only ever lives on-tile and is resolved when the tile is written back.
+	// If that isn't supported, we just don't do MSAA.
+
+	GLint max_samples = 1;
+
+	bool const msaa_supported = d->multiview ? GLAD_GL_OVR_multiview_multisampled_render_to_texture : GLAD_GL_EXT_multisampled_render_to_texture;
+
+	if (msaa_supported) {
+		glGetIntegerv(GL_MAX_SAMPLES_EXT, &max_samples);
+	}
+
+	d->msaa_samples = views[0].recommendedSwapchainSampleCount;
+
+	if (d->msaa_samples > (uint32_t) max_samples) {
+		d->msaa_samples = max_samples;
+	}
+
+	if (d->msaa_samples < 1) {
+		d->msaa_samples = 1;
+	}
+
+	LOGI("Using %ux on-tile MSAA.", d->msaa_samples);
+
+	// Create swapchains.
+	// With multiview, there's a single swapchain with one array layer per view.
+	// Otherwise, there's a separate swapchain for each view.
+
+	d->swapchain_count = d->multiview ? 1 : view_count;
+	d->swapchains = calloc(d->swapchain_count, sizeof *d->swapchains);
+	assert(d->swapchains != NULL);
+
+	d->frame_ubo_offsets = calloc(d->swapchain_count, sizeof *d->frame_ubo_offsets);
+	assert(d->frame_ubo_offsets != NULL);
+
+	for (size_t i = 0; i < d->swapchain_count; i++) {
+		XrViewConfigurationView* const view = &views[i];
+
+		XrSwapchainCreateInfo const create_info = {
+			.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+			.createFlags = 0,
+			.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
+			.format = GL_RGBA8, // TODO
+			.sampleCount = 1,
+			.width = view->recommendedImageRectWidth,
+			.height = view->recommendedImageRectHeight,
+			.faceCount = 1,
+			.arraySize = d->multiview ? view_count : 1,
+			.mipCount = 1,
+		};
+
+		if (swapchain_create(&d->swapchains[i], sesh, &create_info) < 0) {
+			goto err;
+		}
+	}
+
+	// Create a depth swapchain to go along with each colour swapchain, so the compositor can do positional reprojection when we miss a frame.
+	// This is optional, so if the runtime doesn't want to give us these, we just go without.
+
+	d->depth_swapchains = calloc(d->swapchain_count, sizeof *d->depth_swapchains);
+	assert(d->depth_swapchains != NULL);
+
+	for (size_t i = 0; d->opts.depth && i < d->swapchain_count; i++) {
+		swapchain_t* const swapchain = &d->swapchains[i];
+
+		XrSwapchainCreateInfo const create_info = {
+			.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+			.createFlags = 0,
+			.usageFlags = XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			.format = GL_DEPTH_COMPONENT24,
+			.sampleCount = 1,
+			.width = swapchain->x_res,
+			.height = swapchain->y_res,
+			.faceCount = 1,
+			.arraySize = d->multiview ? view_count : 1,
+			.mipCount = 1,
+		};
+
+		if (swapchain_create(&d->depth_swapchains[i], sesh, &create_info) < 0) {
+			LOGW("Failed to create depth swapchain, not submitting depth.");
+
+			for (size_t j = 0; j < i; j++) {
+				swapchain_destroy(&d->depth_swapchains[j]);
+			}
+
+			d->opts.depth = false;
+		}
+	}
+
+	d->projection_pass = d->opts.depth ? &PROJECTION_DEPTH_PASS : &PROJECTION_PASS;
+	LOGI("%s depth.", d->opts.depth ? "Submitting" : "Not submitting");
+
+	// Attach images to their FBOs.
+	// The depth image we'll get along with each colour image isn't known in advance, so start off with the first and swap it out when we render if needs be.
+
+	for (size_t i = 0; i < d->swapchain_count; i++) {
+		swapchain_t* const swapchain = &d->swapchains[i];
+
+		for (size_t j = 0; j < swapchain->image_count; j++) {
+			gl_state_bind_framebuffer(swapchain->fbos[j]);
+			attach_image(d, GL_COLOR_ATTACHMENT0, swapchain->images[j]);
+
+			if (d->opts.depth) {
+				swapchain->attached_depth[j] = d->depth_swapchains[i].images[0];
+				attach_image(d, GL_DEPTH_ATTACHMENT, swapchain->attached_depth[j]);
+			}
+
+			if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				LOGE("Failed to complete framebuffers.");
+				goto err;
+			}
+
+			if (render_pass_verify(d->projection_pass, swapchain->fbos[j]) < 0) {
+				goto err;
+			}
+		}
+	}
+
+	// Depth is enabled for good, as passes which don't need it just don't have a depth attachment.
+
+	glEnable(GL_DEPTH_TEST);
+
+	// Layer views are filled in every frame, but there's always the same number of them.
+
+	d->layer_views = calloc(view_count, sizeof *d->layer_views);
+	assert(d->layer_views != NULL);
+
+	d->depth_infos = calloc(view_count, sizeof *d->depth_infos);
+	assert(d->depth_infos != NULL);
+
+	// There's at most one layer per window plus the projection layer.
+	// The array of pointers to them is grown along with the window layers.
+
+	d->layer_count = 0;
+	d->layers = calloc(1, sizeof *d->layers);
+	assert(d->layers != NULL);
+
+	// Start off at full quality.
+
+	quality_gov_init(&d->quality_gov);
+
+	// The clear texture is drawn on the window panes in the projection layer when using window layers, so that all that's left there is the refraction behind them.
+
+	if (d->opts.win_layers) {
+		glGenTextures(1, &d->clear_tex);
+		gl_state_bind_texture(PANE_TEX_UNIT, d->clear_tex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t[4]) {0, 0, 0, 0});
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	global_desktop = d;
+
+	// Create platform.
+
+	platform_create(&d->plat);
+
+	matrix_identity(d->plat_model);
+	matrix_translate(d->plat_model, (float[3]) {0, -1.8, 0});
+	matrix_rotate_2d(d->plat_model, (float[2]) {0, M_PI / 2});
+
+	return 0;
+
+err:
+
+	desktop_destroy(d);
+	return -1;
+}
+
+void desktop_destroy(desktop_t* d) {
+	// Destroy shaders, including any which were never finished.
+
+	for (size_t i = 0; i < WIN_VARIANT_COUNT; i++) {
+		if (d->win_shader_submitted[i]) {
+			shader_cancel(&d->win_shader_jobs[i]);
+		}
+
+		if (d->win_shaders[i] != 0) {
+			glDeleteProgram(d->win_shaders[i]);
+		}
+	}
+
+	if (d->copy_shader_submitted) {
+		shader_cancel(&d->copy_shader_job);
+	}
+
+	if (d->copy_shader != 0) {
+		glDeleteProgram(d->copy_shader);
+	}
+
+	if (d->clear_tex != 0) {
+		glDeleteTextures(1, &d->clear_tex);
+	}
+
+	ubo_ring_destroy(&d->ubo_ring);
+	free(d->frame_ubo_offsets);
+
+	gpu_timer_destroy(&d->gpu_timer);
+	gl_state_reset();
+
+	// Destroy swapchains and layers.
+
+	for (size_t i = 0; i < d->swapchain_count; i++) {
+		swapchain_destroy(&d->swapchains[i]);
+
+		if (d->depth_swapchains != NULL) {
+			swapchain_destroy(&d->depth_swapchains[i]);
+		}
+	}
+
+	free(d->swapchains);
+	free(d->depth_swapchains);
+	free(d->depth_infos);
+
+	free(d->layer_views);
+	free(d->win_layers);
+	free(d->layers);
+
+	// Destroy windows.
+
+	pthread_mutex_lock(&d->win_mutex);
+
+	for (size_t i = 0; i < d->win_count; i++) {
+		win_destroy(&d->wins[i]);
+	}
+
+	free(d->wins);
+	pthread_mutex_destroy(&d->win_mutex);
+}
+
+// LOD to sample the blurred environment map at through windows.
+// The quality governor biases it towards smaller mips, which are cheaper to sample.
+
+static float win_env_lod(desktop_t* d) {
+	float const lod = WIN_ROUGHNESS * (d->env->blur_levels - 1);
+	return lod + (quality_gov_pulled(&d->quality_gov, QUALITY_LEVER_MIP_BIAS) ? QUALITY_MIP_BIAS : 0);
+}
+
+// Set the LOD uniform of the refraction shader if it changed since last frame.
+// That's the case when the quality governor pulls or releases the mip bias, but also when the environment is switched for one with a different number of blurred levels (e.g. its preview for the full one).
+
+static void update_win_env_lod(desktop_t* d) {
+	if (d->win_shaders[WIN_VARIANT_REFRACTION] == 0) {
+		return;
+	}
+
+	float const lod = win_env_lod(d);
+
+	if (lod == d->win_env_lod) {
+		return;
+	}
+
+	d->win_env_lod = lod;
+
+	gl_state_use_program(d->win_shaders[WIN_VARIANT_REFRACTION]);
+	glUniform1f(d->win_env_lod_uniform, lod);
+}
+
+// Finish creating the shaders started in desktop_create, if they're done.
+// Returns 1 if they are, 0 if they're still being compiled, and -1 if any failed.
+
+static int shaders_finish(desktop_t* d) {
+	if (d->shaders_ready) {
+		return d->shaders_failed ? -1 : 1;
+	}
+
+	for (size_t i = 0; i < WIN_VARIANT_COUNT; i++) {
+		if (d->win_shader_submitted[i] && !shader_ready(&d->win_shader_jobs[i])) {
+			return 0;
+		}
+	}
+
+	if (d->copy_shader_submitted && !shader_ready(&d->copy_shader_job)) {
+		return 0;
+	}
+
+	// Everything's done; set up the window shader variants.
+	// Jobs are marked as no longer submitted as soon as they're finished, so that desktop_destroy doesn't finish them again.
+
+	int rv = 1;
+
+	for (size_t i = 0; i < WIN_VARIANT_COUNT; i++) {
+		if (!d->win_shader_submitted[i]) {
+			continue;
+		}
+
+		GLuint const shader = shader_finish(&d->win_shader_jobs[i]);
+		d->win_shader_submitted[i] = false;
+
+		if (shader == 0) {
+			LOGE("Failed to create %s window shader variant.", WIN_VARIANTS[i].name);
+			rv = -1;
+			continue;
+		}
+
+		d->win_shaders[i] = shader;
+
+		glUniformBlockBinding(shader, glGetUniformBlockIndex(shader, "frame"), FRAME_UBO_BINDING);
+		glUniformBlockBinding(shader, glGetUniformBlockIndex(shader, "win"), WIN_UBO_BINDING);
+
+		// Samplers always read from the same texture units, so they only need setting once.
+		// Uniforms the variant doesn't have have a location of -1, which glUniform* just ignores.
+
+		gl_state_use_program(shader);
+		glUniform1i(glGetUniformLocation(shader, "env"), ENV_TEX_UNIT);
+		glUniform1i(glGetUniformLocation(shader, "win_tex"), PANE_TEX_UNIT);
+	}
+
+	if (d->win_shaders[WIN_VARIANT_REFRACTION] != 0) {
+		d->win_env_lod_uniform = glGetUniformLocation(d->win_shaders[WIN_VARIANT_REFRACTION], "env_lod");
+		d->win_env_lod = -1; // Set on the first frame (see update_win_env_lod).
+	}
+
+	// And the copy shader for window layers.
+
+	if (d->copy_shader_submitted) {
+		d->copy_shader = shader_finish(&d->copy_shader_job);
+		d->copy_shader_submitted = false;
+
+		if (d->copy_shader == 0) {
+			LOGE("Failed to create copy shader.");
+			rv = -1;
+		}
+
+		else {
+			d->copy_sampler_uniform = glGetUniformLocation(d->copy_shader, "win_tex");
+
+			gl_state_use_program(d->copy_shader);
+			glUniform1i(d->copy_sampler_uniform, PANE_TEX_UNIT);
+		}
+	}
+
+	LOGI("Shaders ready %.2f ms after we started creating them.", (clock_now() - d->shaders_start) / 1e6);
+
+	d->shaders_ready = true;
+	d->shaders_failed = rv < 0;
+
+	return rv;
+}
+
+// Whether to refract the environment through windows this frame.
+
+static bool refraction(desktop_t* d) {
+	return d->opts.refraction && !quality_gov_pulled(&d->quality_gov, QUALITY_LEVER_REFRACTION);
+}
+
+static void view_matrices(XrView* view, matrix_t view_matrix, matrix_t proj_matrix) {
+	matrix_identity(proj_matrix);
+	matrix_perspective(proj_matrix, view->fov, NEAR_Z, FAR_Z);
+
+	matrix_identity(view_matrix);
+
+	matrix_rotate_quat(view_matrix, (float*) &view->pose.orientation);
+
+	matrix_translate(view_matrix, (float[3]) {
+												-view->pose.position.x,
+												-view->pose.position.y,
+												-view->pose.position.z,
+											});
+}
+
+// (Re)create a window's swapchain if it doesn't match the window's size anymore.
+// Returns whether a new swapchain was created, in which case it needs to be written to before it can be submitted.
+
+static bool win_swapchain_update(desktop_t* d, win_t* win) {
+	swapchain_t* const swapchain = &win->swapchain;
+
+	if (swapchain->swapchain != XR_NULL_HANDLE && swapchain->x_res == win->x_res && swapchain->y_res == win->y_res) {
+		return false;
+	}
+
+	swapchain_destroy(swapchain);
+	win->layer_ready = false;
+
+	XrSwapchainCreateInfo const create_info = {
+		.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+		.createFlags = 0,
+		.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
+		.format = GL_RGBA8,
+		.sampleCount = 1,
+		.width = win->x_res,
+		.height = win->y_res,
+		.faceCount = 1,
+		.arraySize = 1,
+		.mipCount = 1,
+	};
+
+	if (swapchain_create(swapchain, d->sesh, &create_info) < 0) {
+		return false;
+	}
+
+	for (size_t i = 0; i < swapchain->image_count; i++) {
+		gl_state_bind_framebuffer(swapchain->fbos[i]);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, swapchain->images[i], 0);
+		render_pass_verify(&COPY_PASS, swapchain->fbos[i]);
+	}
+
+	return true;
+}
+
+// Copy a window's contents to the next image of its swapchain.
+
+static void win_swapchain_write(desktop_t* d, win_t* win) {
+	swapchain_t* const swapchain = &win->swapchain;
+	uint32_t img_i = 0;
+
+	if (swapchain_acquire(swapchain, &img_i) < 0) {
+		return;
+	}
+
+	render_pass_begin(&COPY_PASS, swapchain->fbos[img_i], swapchain->x_res, swapchain->y_res);
+
+	gl_state_use_program(d->copy_shader);
+	gl_state_bind_texture(PANE_TEX_UNIT, win->tex);
+	gl_state_bind_vertex_array(0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	render_pass_end(&COPY_PASS);
+
+	swapchain_release(swapchain);
+	win->layer_ready = true;
+}
+
+// Fill in the composition layer for a window from its model matrix.
+// Windows only ever rotate around the Y axis, so the orientation is just that yaw, which we can get back from where the model matrix sends the X axis.
+// The layer only covers the part of the pane the window contents are mapped to, i.e. without the rounded corners.
+
+static void win_layer_fill(desktop_t* d, XrSpace space, win_t* win, win_layer_t* layer) {
+	float const yaw = atan2(-win->model[0][2], win->model[0][0]);
+
+	XrQuaternionf const orientation = {
+		.x = 0,
+		.y = sin(yaw / 2),
+		.z = 0,
+		.w = cos(yaw / 2),
+	};
+
+	float const width = (float) win->x_res / WIN_PIXELS_PER_UNIT - 2 * PANE_CORNER_RADIUS;
+	float const height = ((float) win->y_res / WIN_PIXELS_PER_UNIT - 2 * PANE_CORNER_RADIUS) * win->height;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+	XrSwapchainSubImage const sub_image = {
+		.swapchain = win->swapchain.swapchain,
+		.imageRect = {
+			.offset = {0, 0},
+			.extent = {win->swapchain.x_res, win->swapchain.y_res},
+		},
+		.imageArrayIndex = 0,
+	};
 
-out vec3 world_pos;
-out vec3 world_normal;
-out vec2 interp_tex_coord;
+	XrCompositionLayerFlags const flags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_CORRECT_CHROMATIC_ABERRATION_BIT;
+
+	// Cylinder layers are posed at the centre of the cylinder, which is the axis the window's pane is curved around.
+	// Panes face towards their axis, so that's along the Z axis of the model matrix.
+
+	if (d->opts.cylinder_layers) {
+		float const* const z = win->model[2];
+		float const z_norm = sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+
+		layer->cylinder = (XrCompositionLayerCylinderKHR) {
+			.type = XR_TYPE_COMPOSITION_LAYER_CYLINDER_KHR,
+			.next = NULL,
+			.layerFlags = flags,
+			.space = space,
+			.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+			.subImage = sub_image,
+			.pose = {
+				.orientation = orientation,
+				.position = {
+					.x = win->model[3][0] + z[0] / z_norm * WIN_CURVE_RADIUS,
+					.y = win->model[3][1] + z[1] / z_norm * WIN_CURVE_RADIUS,
+					.z = win->model[3][2] + z[2] / z_norm * WIN_CURVE_RADIUS,
+				},
+			},
+			.radius = WIN_CURVE_RADIUS,
+			.centralAngle = width / WIN_CURVE_RADIUS,
+			.aspectRatio = width / height,
+		};
 
-void main() {
-	vec4 world_pos_4 = model * vec4(pos, 1.0);
-	world_pos = world_pos_4.xyz;
-	world_normal = mat3(model) * normal;
-	interp_tex_coord = tex_coord;
+		return;
+	}
 
-	gl_Position = proj * view * world_pos_4;
+	layer->quad = (XrCompositionLayerQuad) {
+		.type = XR_TYPE_COMPOSITION_LAYER_QUAD,
+		.next = NULL,
+		.layerFlags = flags,
+		.space = space,
+		.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+		.subImage = sub_image,
+		.pose = {
+			.orientation = orientation,
+			.position = {win->model[3][0], win->model[3][1], win->model[3][2]},
+		},
+		.size = {width, height},
+	};
 }
-);
 
-static char const* const WIN_SHADER_FRAG_SRC = MULTILINE(
-\#version 310 es\n
-precision highp float;
+// Update everything in the scene which doesn't depend on the view, so that it's only done once per frame rather than once per view.
+// This also means animations advance at the same rate regardless of how many views we have.
+// Views here are only used for deciding what to upload and how finely to tessellate windows, so they don't need to be as fresh as those we draw with (see late_latch).
+// The uniform ring is left mapped with room reserved for the 'frame' blocks, which are returned in 'frames'.
 
-in vec3 world_pos;
-in vec3 world_normal;
-in vec2 interp_tex_coord;
+static void update(desktop_t* d, arena_t* arena, XrSpace space, XrTime predicted_display_time, XrView* views, frame_ubo_t** frames) {
+	// Get time elapsed since the last frame.
 
-uniform sampler2D env;
-uniform sampler2D win_tex;
-uniform vec3 camera_pos;
+	float dt = 0;
 
-out vec4 frag_colour;
+	if (d->last_display_time != 0) {
+		dt = (predicted_display_time - d->last_display_time) / 1e9;
+	}
 
-const float PI = 3.14159265359;
+	d->last_display_time = predicted_display_time;
 
-vec2 dir_to_equirect(vec3 dir) {
-	float lon = atan(dir.z, dir.x) + PI / 2.0;
-	float lat = asin(clamp(dir.y, -1.0, 1.0));
-	return vec2(lon / (2.0 * PI) + 0.5, lat / PI + 0.5);
-}
+	// The head is somewhere in between all the views.
 
-void main() {
-	vec3 N = normalize(world_normal);
-	vec3 V = normalize(world_pos - camera_pos);
+	float head[3] = {0, 0, 0};
 
-	/* TODO Fresnel? */
+	for (size_t i = 0; i < d->view_count; i++) {
+		head[0] += views[i].pose.position.x / d->view_count;
+		head[1] += views[i].pose.position.y / d->view_count;
+		head[2] += views[i].pose.position.z / d->view_count;
+	}
 
-	vec3 R = refract(V, N, 1.0 / 1.333 /* water */);
+	// Get the matrices of each view, and their frustums to cull windows against.
 
-	vec2 uv = dir_to_equirect(normalize(R));
-	vec3 colour = texture(env, uv).rgb;
-	vec4 win_colour = texture(win_tex, interp_tex_coord);
-	vec3 unpremultiplied = win_colour.bgr / max(win_colour.a, 1e-8);
+	assert(d->view_count <= 32); // Because visibility is tracked as a bitmask.
 
-	frag_colour = vec4(unpremultiplied * win_colour.a + colour.rgb * (1.0 - win_colour.a), 1.0);
-}
-);
-// clang-format on
+	matrix_t* const view_mats = arena_alloc(arena, d->view_count, sizeof *view_mats);
+	matrix_t* const proj_mats = arena_alloc(arena, d->view_count, sizeof *proj_mats);
+	frustum_t* const frustums = arena_alloc(arena, d->view_count, sizeof *frustums);
 
-static desktop_t* global_desktop = NULL;
+	assert(view_mats != NULL);
+	assert(proj_mats != NULL);
+	assert(frustums != NULL);
 
-int desktop_create(desktop_t* d, XrSession sesh, size_t view_count, XrViewConfigurationView* views, mist_env_t* env) {
-	// TODO Maybe the desktop should be responsible for the environment too?
+	for (size_t i = 0; i < d->view_count; i++) {
+		view_matrices(&views[i], view_mats[i], proj_mats[i]);
+		frustum_from_view(&frustums[i], view_mats[i], views[i].fov);
+	}
 
-	d->sesh = sesh;
-	d->env = env;
-	d->win_count = 0;
-	d->wins = NULL;
-	d->view_count = view_count;
-	pthread_mutex_init(&d->win_mutex, NULL);
+	// Update windows.
 
-	// Create swapchains.
+	pthread_mutex_lock(&d->win_mutex);
 
-	d->swapchains = calloc(view_count, sizeof *d->swapchains);
-	assert(d->swapchains != NULL);
+	size_t win_count = 0;
 
-	for (size_t i = 0; i < view_count; i++) {
-		XrViewConfigurationView* const view = &views[i];
-		swapchain_t* const swapchain = &d->swapchains[i];
+	for (size_t i = 0; i < d->win_count; i++) {
+		if (!d->wins[i].destroyed) {
+			win_count++;
+		}
+	}
 
-		swapchain->x_res = view->recommendedImageRectWidth;
-		swapchain->y_res = view->recommendedImageRectHeight;
+	// Reserve this frame's uniform blocks.
+	// Windows each get their block as they're updated below, but 'frame' blocks are only written once we've got our final view poses.
 
-		XrSwapchainCreateInfo const create_info = {
-			.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
-			.createFlags = 0,
-			.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
-			.format = GL_RGBA8, // TODO
-			.sampleCount = view->recommendedSwapchainSampleCount,
-			.width = swapchain->x_res,
-			.height = swapchain->y_res,
-			.faceCount = 1,
-			.arraySize = 1,
-			.mipCount = 1,
-		};
+	size_t const ubo_size = d->swapchain_count * ubo_ring_stride(&d->ubo_ring, sizeof(frame_ubo_t)) + win_count * ubo_ring_stride(&d->ubo_ring, sizeof(win_ubo_t));
+	ubo_ring_begin(&d->ubo_ring, ubo_size);
 
-		if (xrCreateSwapchain(sesh, &create_info, &swapchain->swapchain) != XR_SUCCESS) {
-			LOGE("Failed to create swapchain.");
-			goto err;
+	for (size_t i = 0; i < d->swapchain_count; i++) {
+		frames[i] = ubo_ring_alloc(&d->ubo_ring, sizeof *frames[i], &d->frame_ubo_offsets[i]);
+	}
+
+	// Work out which way we're looking, to know which window we're focused on.
+	// The view matrix's third row is the view's Z axis in world space, and views look down -Z.
+
+	float const forward[3] = {
+		-view_mats[0][0][2],
+		-view_mats[0][1][2],
+		-view_mats[0][2][2],
+	};
+
+	float best_focus = -INFINITY;
+	uint32_t focused_win = d->focused_win;
+
+	bool const lod_pulled = quality_gov_pulled(&d->quality_gov, QUALITY_LEVER_TESSELLATION);
+	bool const upload_pulled = quality_gov_pulled(&d->quality_gov, QUALITY_LEVER_UPLOAD_RATE);
+
+	float const angle_between = M_PI / 7;
+	float cur_angle = -(angle_between * (win_count - 1)) / 2;
+
+	// Make sure there's room for a layer per window, plus the projection layer.
+
+	if (d->opts.win_layers && win_count > d->win_layer_cap) {
+		d->win_layer_cap = win_count;
+
+		d->win_layers = realloc(d->win_layers, d->win_layer_cap * sizeof *d->win_layers);
+		assert(d->win_layers != NULL);
+
+		d->layers = realloc(d->layers, (d->win_layer_cap + 1) * sizeof *d->layers);
+		assert(d->layers != NULL);
+	}
+
+	d->win_layer_count = 0;
+	d->overflow_win_count = 0;
+
+	size_t own_layer_count = 0;
+
+	for (size_t i = 0; i < d->win_count; i++) {
+		win_t* const win = &d->wins[i];
+
+		if (win->destroyed) {
+			if (win->created) {
+				win_destroy(win);
+				win->created = false;
+			}
+
+			continue;
+		}
+
+		if (!win->created) {
+			win->created = true;
+			win_create(win);
 		}
 
-		// Get images and give them all FBOs.
+		win->target_rot = cur_angle;
+		win_update(win, dt);
 
-		uint32_t image_count = 0;
+		// Windows are laid out on a ring around the user.
+		// There's only ever a rotation around the Y axis, so no need for matrix_rotate_2d.
 
-		if (xrEnumerateSwapchainImages(swapchain->swapchain, 0, &image_count, NULL) != XR_SUCCESS) {
-			LOGE("Failed to enumerate swapchain images.");
-			goto err;
+		matrix_identity(win->model);
+
+		matrix_scale(win->model, (float[3]) {1, win->height, 1});
+		matrix_translate(win->model, (float[3]) {0, 0, 7});
+		matrix_rotate(win->model, -win->rot, (float[3]) {0, 1, 0});
+		matrix_translate(win->model, (float[3]) {0, .3, -10});
+
+		// Pick a tessellation level based on how far the window is from us.
+		// The model matrix's translation is the centre of the window.
+
+		float const dx = win->model[3][0] - head[0];
+		float const dy = win->model[3][1] - head[1];
+		float const dz = win->model[3][2] - head[2];
+
+		float const dist = sqrt(dx * dx + dy * dy + dz * dz);
+
+		win_select_lod(win, lod_pulled ? dist * QUALITY_LOD_ERROR_SCALE : dist);
+
+		// The window we're focused on is the one closest to the centre of our view.
+
+		float const focus = (dx * forward[0] + dy * forward[1] + dz * forward[2]) / dist;
+
+		if (focus > best_focus) {
+			best_focus = focus;
+			focused_win = win->id;
 		}
 
-		XrSwapchainImageOpenGLESKHR* const images = calloc(image_count, sizeof *images);
-		assert(images != NULL);
+		// Cull the window against each view.
+		// Windows which aren't in any view don't need their contents uploading either; they stay dirty until they come back into view.
 
-		for (size_t j = 0; j < image_count; j++) {
-			images[j].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
+		float const radius = win_bounding_radius(win);
+		win->visible_views = 0;
+
+		for (size_t j = 0; j < d->view_count; j++) {
+			if (frustum_sphere_visible(&frustums[j], win->model[3], radius)) {
+				win->visible_views |= 1u << j;
+			}
 		}
 
-		if (
-			xrEnumerateSwapchainImages(
-				swapchain->swapchain,
-				image_count,
-				&image_count,
-				(XrSwapchainImageBaseHeader*) images
-			) != XR_SUCCESS
-		) {
-			LOGE("Failed to enumerate swapchain images.");
-			free(images);
-			goto err;
+		// Under pressure, only upload the contents of windows we're not focused on every so often.
+		// This is staggered so that they don't all get uploaded on the same frame.
+
+		bool const throttled = upload_pulled && win->id != d->focused_win && (d->frame_index + i) % QUALITY_UPLOAD_INTERVAL != 0;
+		bool const dirty = win->visible_views != 0 && !throttled && win_upload(win);
+
+		// Every window gets a block, as it might only come into view once views are located again.
+
+		win_ubo_t* const ubo = ubo_ring_alloc(&d->ubo_ring, sizeof *ubo, &win->ubo_offset);
+
+		if (ubo != NULL) {
+			matrix_copy(ubo->model, win->model);
 		}
 
-		swapchain->image_count = image_count;
-		swapchain->fbos = calloc(image_count, sizeof *swapchain->fbos);
-		assert(swapchain->fbos != NULL);
+		// When the window is its own layer, its swapchain only needs writing to when its contents change (or it was just recreated, or it wasn't its own layer last frame, in which case it's missed any changes since).
+		// The layer itself has to be filled in every frame though, as the window might be moving.
+		// Windows past the layer limit are drawn into the projection layer instead.
 
-		glGenFramebuffers(image_count, swapchain->fbos);
+		bool const was_own_layer = win->own_layer;
+		win->own_layer = d->opts.win_layers && own_layer_count < d->opts.max_win_layers;
 
-		for (size_t j = 0; j < image_count; j++) {
-			// XXX When we move on to using multiview, we should use glFramebufferTextureMultiviewOVR here.
+		if (d->opts.win_layers && !win->own_layer) {
+			d->overflow_win_count++;
+		}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, swapchain->fbos[j]);
-			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, (GLuint) images[j].image, 0);
+		if (win->own_layer) {
+			own_layer_count++;
+			bool const recreated = win_swapchain_update(d, win);
 
-			if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-				LOGE("Failed to complete framebuffers.");
-				free(images);
-				goto err;
+			if (win->swapchain.swapchain != XR_NULL_HANDLE && (dirty || recreated || !was_own_layer)) {
+				win_swapchain_write(d, win);
+			}
+
+			if (win->layer_ready) {
+				win_layer_fill(d, space, win, &d->win_layers[d->win_layer_count++]);
 			}
 		}
 
-		free(images);
+		cur_angle += angle_between;
 	}
 
-	// Create shader.
+	d->focused_win = focused_win;
+	d->frame_index++;
+
+	pthread_mutex_unlock(&d->win_mutex);
+}
+
+// Locate views again right before drawing, now that everything else for the frame is done, and write them to the 'frame' blocks reserved by update.
+// Windows are culled again against these, but their contents are only uploaded if they were already visible with the views update used; those which just came into view show stale contents for a frame.
+// If locating views fails, we just keep using the ones we already have.
+
+static void late_latch(desktop_t* d, arena_t* arena, XrViewLocateInfo const* locate_info, XrView* views, frame_ubo_t** frames) {
+	uint64_t const latch_start = clock_now();
 
-	d->win_shader = create_shader(WIN_SHADER_VERT_SRC, WIN_SHADER_FRAG_SRC);
+	XrViewState view_state = {XR_TYPE_VIEW_STATE};
+	uint32_t view_count;
 
-	if (d->win_shader == 0) {
-		LOGE("Failed to create window shader.");
-		goto err;
+	if (xrLocateViews(d->sesh, locate_info, &view_state, d->view_count, &view_count, views) != XR_SUCCESS) {
+		LOGW("Failed to locate views again, using the ones from the start of the frame.");
 	}
 
-	d->win_model_uniform = glGetUniformLocation(d->win_shader, "model");
-	d->win_view_uniform = glGetUniformLocation(d->win_shader, "view");
-	d->win_proj_uniform = glGetUniformLocation(d->win_shader, "proj");
+	d->pose_time = clock_now();
+	d->stats.latch_delay = latch_start - d->frame_start_time;
 
-	d->win_camera_pos_uniform = glGetUniformLocation(d->win_shader, "camera_pos");
-	d->win_env_sampler_uniform = glGetUniformLocation(d->win_shader, "env");
-	d->win_sampler_uniform = glGetUniformLocation(d->win_shader, "win_tex");
+	// Recompute view matrices and frustums.
 
-	global_desktop = d;
+	matrix_t* const view_mats = arena_alloc(arena, d->view_count, sizeof *view_mats);
+	matrix_t* const proj_mats = arena_alloc(arena, d->view_count, sizeof *proj_mats);
+	frustum_t* const frustums = arena_alloc(arena, d->view_count, sizeof *frustums);
 
-	// Create platform.
+	assert(view_mats != NULL);
+	assert(proj_mats != NULL);
+	assert(frustums != NULL);
 
-	platform_create(&d->plat);
+	for (size_t i = 0; i < d->view_count; i++) {
+		view_matrices(&views[i], view_mats[i], proj_mats[i]);
+		frustum_from_view(&frustums[i], view_mats[i], views[i].fov);
+	}
 
-	return 0;
+	// Write the 'frame' blocks.
 
-err:
+	for (size_t i = 0; i < d->swapchain_count; i++) {
+		frame_ubo_t* const frame = frames[i];
 
-	desktop_destroy(d);
-	return -1;
-}
+		if (frame == NULL) {
+			continue;
+		}
 
-void desktop_destroy(desktop_t* d) {
-	// Destroy shader.
+		for (size_t j = 0; j < MULTIVIEW_VIEW_COUNT && j < d->view_count; j++) {
+			size_t const view_i = (i + j) % d->view_count;
+			XrVector3f const* const pos = &views[view_i].pose.position;
+
+			matrix_copy(frame->view[j], view_mats[view_i]);
+			matrix_copy(frame->proj[j], proj_mats[view_i]);
 
-	if (d->win_shader == 0) {
-		glDeleteShader(d->win_shader);
+			frame->camera_pos[j][0] = pos->x;
+			frame->camera_pos[j][1] = pos->y;
+			frame->camera_pos[j][2] = pos->z;
+			frame->camera_pos[j][3] = 1;
+		}
 	}
 
-	// Destroy swapchains.
+	ubo_ring_end(&d->ubo_ring);
 
-	for (size_t i = 0; i < d->view_count; i++) {
-		swapchain_t* const swapchain = &d->swapchains[i];
+	// Cull windows again.
+
+	pthread_mutex_lock(&d->win_mutex);
+
+	for (size_t i = 0; i < d->win_count; i++) {
+		win_t* const win = &d->wins[i];
 
-		if (swapchain->swapchain == NULL) {
+		if (win->destroyed || !win->created) {
 			continue;
 		}
 
-		glDeleteFramebuffers(swapchain->image_count, swapchain->fbos);
-		xrDestroySwapchain(d->swapchains[i].swapchain);
+		float const radius = win_bounding_radius(win);
+		win->visible_views = 0;
+
+		for (size_t j = 0; j < d->view_count; j++) {
+			if (frustum_sphere_visible(&frustums[j], win->model[3], radius)) {
+				win->visible_views |= 1u << j;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&d->win_mutex);
+}
+
+// Pick the cheapest variant of the window shader which can draw a window.
+// Returns WIN_VARIANT_COUNT if the window needn't be drawn at all, which is the case for windows in their own layers which have no refraction to draw behind them (because they're opaque or refraction is off).
+
+static win_variant_t win_variant(desktop_t* d, win_t* win) {
+	bool const opaque = win_opaque(win);
+
+	if (win->own_layer) {
+		return opaque || !refraction(d) ? WIN_VARIANT_COUNT : WIN_VARIANT_REFRACTION;
 	}
 
-	free(d->swapchains);
+	if (opaque) {
+		return WIN_VARIANT_OPAQUE;
+	}
 
-	// Destroy windows.
+	return refraction(d) ? WIN_VARIANT_REFRACTION : WIN_VARIANT_TRANSLUCENT;
+}
+
+// Draw everything in the scene which is visible in any of the views in 'view_mask'.
+// This assumes the 'frame' block and environment map are bound.
+
+static void draw_scene(desktop_t* d, uint32_t view_mask) {
+	// Render platform.
+
+	// TODO Give the platform a 'win' block too.
+	// platform_render(&d->plat);
+
+	// Render windows.
+	// Everything has already been updated for this frame, so we just need to draw them.
 
 	pthread_mutex_lock(&d->win_mutex);
 
 	for (size_t i = 0; i < d->win_count; i++) {
-		win_destroy(&d->wins[i]);
+		win_t* const win = &d->wins[i];
+
+		if (win->destroyed || !win->created) {
+			continue;
+		}
+
+		if (!(win->visible_views & view_mask)) {
+			d->stats.culled++;
+			continue;
+		}
+
+		win_variant_t const variant = win_variant(d, win);
+
+		if (variant == WIN_VARIANT_COUNT) {
+			continue;
+		}
+
+		d->stats.drawn++;
+
+		assert(d->win_shaders[variant] != 0);
+		gl_state_use_program(d->win_shaders[variant]);
+		gl_state_bind_uniform_buffer(WIN_UBO_BINDING, d->ubo_ring.ubo, win->ubo_offset, sizeof(win_ubo_t));
+
+		if (!win->own_layer) {
+			win_render(win);
+			continue;
+		}
+
+		// The window contents are in their own layer, so only draw the refraction behind them.
+
+		gl_state_bind_texture(PANE_TEX_UNIT, d->clear_tex);
+		pane_render(&win->panes[win->lod]);
 	}
 
-	free(d->wins);
-	pthread_mutex_destroy(&d->win_mutex);
+	pthread_mutex_unlock(&d->win_mutex);
 }
 
 int desktop_render(
 	desktop_t* d,
+	arena_t* arena,
 	XrSpace space,
 	XrViewConfigurationType view_config,
 	XrTime predicted_display_time,
-	XrCompositionLayerProjection* layer,
-	XrCompositionLayerProjectionView** layer_views
+	XrDuration predicted_display_period,
+	size_t* layer_count,
+	XrCompositionLayerBaseHeader const* const** layers
 ) {
+	d->frame_start_time = clock_now();
+	d->pose_time = 0;
+	d->display_period = predicted_display_period;
+
+	// Nothing to render until our shaders are ready.
+	// Until then, there's just the environment.
+
+	int const shaders = shaders_finish(d);
+
+	if (shaders < 0) {
+		return -1;
+	}
+
+	if (shaders == 0) {
+		*layer_count = 0;
+		*layers = d->layers;
+
+		return 0;
+	}
+
 	// Get view information.
+	// These are only used to prepare the scene; we locate views again right before drawing so that the poses we draw with are as fresh as possible.
 
 	XrViewState view_state = {XR_TYPE_VIEW_STATE};
 
-	XrViewLocateInfo view_locate_info = {
+	XrViewLocateInfo const view_locate_info = {
 		.type = XR_TYPE_VIEW_LOCATE_INFO,
 		.viewConfigurationType = view_config,
 		.displayTime = predicted_display_time,
 		.space = space,
 	};
 
-	XrView* const views = calloc(d->view_count, sizeof *views);
+	XrView* const views = arena_alloc(arena, d->view_count, sizeof *views);
 	assert(views != NULL);
 
 	for (size_t i = 0; i < d->view_count; i++) {
@@ -265,177 +1349,257 @@ int desktop_render(
 
 	if (xrLocateViews(d->sesh, &view_locate_info, &view_state, d->view_count, &view_count, views) != XR_SUCCESS) {
 		LOGE("Failed to locate views.");
-		free(views);
 		return -1;
 	}
 
-	*layer_views = calloc(d->view_count, sizeof **layer_views);
-	assert(*layer_views != NULL);
+	// Update the scene once for all views.
 
-	// Render for each view.
+	uint64_t const last_gpu_time = d->stats.gpu_time;
+	uint64_t const last_pose_latency = d->stats.pose_latency;
 
-	for (size_t i = 0; i < d->view_count; i++) {
+	d->stats = (desktop_stats_t) {0};
+	d->stats.pose_latency = last_pose_latency;
+
+	frame_ubo_t** const frames = arena_alloc(arena, d->swapchain_count, sizeof *frames);
+	assert(frames != NULL);
+
+	update(d, arena, space, predicted_display_time, views, frames);
+
+	// If windows are all in their own layers, the projection layer is only needed for refraction.
+	// In that case, there's nothing to draw with the views, so no need to locate them again.
+
+	d->layer_count = 0;
+
+	if (d->opts.win_layers && !refraction(d) && d->overflow_win_count == 0) {
+		ubo_ring_end(&d->ubo_ring);
+		goto layers;
+	}
+
+	// Pick the resolution to render at from how long the GPU took on previous frames.
+
+	uint64_t gpu_time = last_gpu_time;
+
+	while (gpu_timer_poll(&d->gpu_timer, &gpu_time)) {
+		res_gov_update(&d->res_gov, gpu_time, predicted_display_period);
+	}
+
+	d->stats.gpu_time = gpu_time;
+	d->stats.render_scale = d->res_gov.scale;
+
+	// Everything else is ready, so get the freshest views we can.
+
+	late_latch(d, arena, &view_locate_info, views, frames);
+
+	gpu_timer_begin(&d->gpu_timer);
+	update_win_env_lod(d);
+
+	// Render to each swapchain.
+	// With multiview, this is a single pass for all views.
+
+	for (size_t i = 0; i < d->swapchain_count; i++) {
 		swapchain_t* const swapchain = &d->swapchains[i];
-		XrView* const view = &views[i];
 
 		// Acquire swapchain image.
 
 		uint32_t img_i = 0;
-		XrSwapchainImageAcquireInfo acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
 
-		if (xrAcquireSwapchainImage(swapchain->swapchain, &acquire_info, &img_i) != XR_SUCCESS) {
-			LOGE("Failed to acquire swapchain.");
+		if (swapchain_acquire(swapchain, &img_i) < 0) {
 			continue; // TODO I guess we fail all rendering in this situation?
 		}
 
-		XrSwapchainImageWaitInfo wait_info = {
-			.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
-			.timeout = XR_INFINITE_DURATION,
-		};
+		// Acquire the depth image to go with it.
+		// Runtimes don't have to hand out depth images in lockstep with colour images, so attach it to the FBO if it's not the one already there.
 
-		if (xrWaitSwapchainImage(swapchain->swapchain, &wait_info) != XR_SUCCESS) {
-			LOGE("Failed to wait for swapchain.");
-			goto release; // TODO Ditto as above.
-		}
+		swapchain_t* const depth_swapchain = &d->depth_swapchains[i];
+
+		if (d->opts.depth) {
+			uint32_t depth_img_i = 0;
+
+			if (swapchain_acquire(depth_swapchain, &depth_img_i) < 0) {
+				swapchain_release(swapchain);
+				continue;
+			}
 
-		// Set up matrices.
+			GLuint const depth_image = depth_swapchain->images[depth_img_i];
+
+			if (swapchain->attached_depth[img_i] != depth_image) {
+				gl_state_bind_framebuffer(swapchain->fbos[img_i]);
+				attach_image(d, GL_DEPTH_ATTACHMENT, depth_image);
+				swapchain->attached_depth[img_i] = depth_image;
+			}
+		}
 
-		matrix_t proj_matrix;
-		matrix_identity(proj_matrix);
-		matrix_perspective(proj_matrix, view->fov, 0.1, 500);
+		// Start the pass and bind its 'frame' block.
 
-		matrix_t view_matrix;
-		matrix_identity(view_matrix);
+		GLsizei const x_res = fmax(1, round(swapchain->x_res * d->res_gov.scale));
+		GLsizei const y_res = fmax(1, round(swapchain->y_res * d->res_gov.scale));
 
-		matrix_rotate_quat(view_matrix, (float*) &view->pose.orientation);
+		render_pass_begin(d->projection_pass, swapchain->fbos[img_i], x_res, y_res);
 
-		matrix_translate(view_matrix, (float[3]) {
-													-view->pose.position.x,
-													-view->pose.position.y,
-													-view->pose.position.z,
-												});
+		gl_state_bind_uniform_buffer(FRAME_UBO_BINDING, d->ubo_ring.ubo, d->frame_ubo_offsets[i], sizeof(frame_ubo_t));
 
 		// Actually render.
 
-		glBindFramebuffer(GL_FRAMEBUFFER, swapchain->fbos[img_i]);
+		if (d->env->cubemap) {
+			gl_state_bind_texture_cube(ENV_TEX_UNIT, d->env->blur_tex);
+		}
+
+		else {
+			gl_state_bind_texture(ENV_TEX_UNIT, d->env->blur_tex);
+		}
+
+		// Draw whatever's visible in the views this pass renders to.
+
+		size_t const first_view = d->multiview ? 0 : i;
+		size_t const pass_view_count = d->multiview ? d->view_count : 1;
 
-		glUseProgram(d->win_shader); // TODO Does this only apply to bound framebuffer? Or global state? Test this out.
+		draw_scene(d, ((1u << pass_view_count) - 1) << first_view);
 
-		glUniformMatrix4fv(d->win_view_uniform, 1, false, (void*) &view_matrix);
-		glUniformMatrix4fv(d->win_proj_uniform, 1, false, (void*) &proj_matrix);
-		glUniform3fv(d->win_camera_pos_uniform, 1, (float*) &view->pose.position);
+		// Populate the layer views we've rendered to.
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, d->env->blur_equirect_tex);
-		glUniform1i(d->win_env_sampler_uniform, 0);
+		for (size_t j = first_view; j < first_view + pass_view_count; j++) {
+			XrCompositionLayerProjectionView* const layer_view = &d->layer_views[j];
+			XrView* const view = &views[j];
 
-		glViewport(0, 0, swapchain->x_res, swapchain->y_res);
+			layer_view->type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
+			layer_view->next = NULL;
 
-		glClearColor(0.0, 0.0, 0.0, 0.0);
-		glClear(GL_COLOR_BUFFER_BIT);
+			layer_view->fov = view->fov;
+			layer_view->pose = view->pose;
 
-		// Render platform.
+			layer_view->subImage.swapchain = swapchain->swapchain;
+			layer_view->subImage.imageArrayIndex = d->multiview ? j : 0;
 
-		// platform_render(&d->plat, d->win_sampler_uniform);
+			layer_view->subImage.imageRect = (XrRect2Di) {
+				.offset = {    0,     0},
+				.extent = {x_res, y_res},
+			};
 
-		matrix_t model_matrix;
-		matrix_identity(model_matrix);
+			// Chain depth info for the compositor.
+			// Our projection matrix maps the near plane to 0 and the far plane to 1 in the depth buffer.
 
-		matrix_translate(model_matrix, (float[3]) {0, -1.8, 0});
-		matrix_rotate_2d(model_matrix, (float[2]) {0, M_PI / 2});
-		glUniformMatrix4fv(d->win_model_uniform, 1, false, (void*) &model_matrix);
+			if (d->opts.depth) {
+				XrCompositionLayerDepthInfoKHR* const depth_info = &d->depth_infos[j];
 
-		// Render windows.
+				depth_info->type = XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR;
+				depth_info->next = NULL;
 
-		pthread_mutex_lock(&d->win_mutex);
+				depth_info->subImage.swapchain = depth_swapchain->swapchain;
+				depth_info->subImage.imageArrayIndex = layer_view->subImage.imageArrayIndex;
+				depth_info->subImage.imageRect = layer_view->subImage.imageRect;
 
-		size_t win_count = 0;
+				depth_info->minDepth = 0;
+				depth_info->maxDepth = 1;
+				depth_info->nearZ = NEAR_Z;
+				depth_info->farZ = FAR_Z;
 
-		for (size_t j = 0; j < d->win_count; j++) {
-			if (!d->wins[j].destroyed) {
-				win_count++;
+				layer_view->next = depth_info;
 			}
 		}
 
-		float const angle_between = M_PI / 7;
-		float cur_angle = -(angle_between * (win_count - 1)) / 2;
+		render_pass_end(d->projection_pass);
+		swapchain_release(swapchain);
+
+		if (d->opts.depth) {
+			swapchain_release(depth_swapchain);
+		}
+	}
 
-		for (size_t j = 0; j < d->win_count; j++) {
-			win_t* const win = &d->wins[j];
+	gpu_timer_end(&d->gpu_timer);
 
-			if (win->destroyed) {
-				if (win->created) {
-					win_destroy(win);
-					win->created = false;
-				}
+	// Fill in projection layer.
 
-				continue;
-			}
+	d->layer.type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
+	d->layer.next = NULL;
 
-			if (!win->created) {
-				win->created = true;
-				win_create(win);
-			}
+	d->layer.layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_CORRECT_CHROMATIC_ABERRATION_BIT;
+	d->layer.space = space;
 
-			matrix_t model_matrix;
-			matrix_identity(model_matrix);
+	d->layer.viewCount = d->view_count;
+	d->layer.views = d->layer_views;
 
-			matrix_scale(model_matrix, (float[3]) {1, win->height, 1});
-			matrix_translate(model_matrix, (float[3]) {0, 0, 7});
-			matrix_rotate_2d(model_matrix, (float[2]) {-win->rot, 0});
-			matrix_translate(model_matrix, (float[3]) {0, .3, -10});
-			glUniformMatrix4fv(d->win_model_uniform, 1, false, (void*) &model_matrix);
+	d->layers[d->layer_count++] = (XrCompositionLayerBaseHeader const*) &d->layer;
 
-			win->target_rot = cur_angle;
-			win_render(win, d->win_sampler_uniform);
+layers:
 
-			cur_angle += angle_between;
-		}
+	// Window layers go on top of the projection layer.
 
-		pthread_mutex_unlock(&d->win_mutex);
+	for (size_t i = 0; i < d->win_layer_count; i++) {
+		d->layers[d->layer_count++] = &d->win_layers[i].base;
+	}
 
-		// Populate relevant layer view.
+	*layer_count = d->layer_count;
+	*layers = d->layers;
+
+	// Log statistics every so often.
+
+	d->stats.gl = gl_state_take_stats();
+
+	if (predicted_display_time - d->last_stats_time >= STATS_INTERVAL) {
+		LOGI(
+			"Windows drawn: %zu, culled: %zu. GPU time: %.2f ms, render scale: %.2f. GL state changes issued: %zu, elided: %zu. Views relocated %.2f ms into the frame, %.2f ms from pose to xrEndFrame.",
+			d->stats.drawn,
+			d->stats.culled,
+			d->stats.gpu_time / 1e6,
+			d->stats.render_scale,
+			d->stats.gl.issued,
+			d->stats.gl.elided,
+			d->stats.latch_delay / 1e6,
+			d->stats.pose_latency / 1e6
+		);
+		d->last_stats_time = predicted_display_time;
+	}
 
-		XrCompositionLayerProjectionView* const layer_view = &(*layer_views)[i];
+	return 0;
+}
 
-		layer_view->type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
-		layer_view->next = NULL;
+// Pull or release quality levers and act on it.
 
-		layer_view->fov = view->fov;
-		layer_view->pose = view->pose;
+static void quality_update(desktop_t* d, uint64_t frame_time) {
+	size_t const prev_level = d->quality_gov.level;
+	size_t const level = quality_gov_update(&d->quality_gov, frame_time, d->display_period);
 
-		layer_view->subImage.swapchain = swapchain->swapchain;
-		layer_view->subImage.imageArrayIndex = 0;
+	if (level == prev_level) {
+		return;
+	}
 
-		layer_view->subImage.imageRect = (XrRect2Di) {
-			.offset = {               0,                0},
-			.extent = {swapchain->x_res, swapchain->y_res},
-		};
+	quality_lever_t const lever = level > prev_level ? prev_level : level;
 
-release:;
+	LOGI(
+		"Frame time %.2f ms over a %.2f ms budget, %s '%s' quality lever (%zu/%d pulled).",
+		frame_time / 1e6,
+		d->display_period / 1e6,
+		level > prev_level ? "pulling" : "releasing",
+		quality_lever_name(lever),
+		level,
+		QUALITY_LEVER_COUNT
+	);
 
-		XrSwapchainImageReleaseInfo release_info = {XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+	// Everything, including the mip bias (see update_win_env_lod), is picked up by the next update or render or when picking shader variants.
+}
 
-		if (xrReleaseSwapchainImage(swapchain->swapchain, &release_info) != XR_SUCCESS) {
-			LOGE("Failed to release swapchain.");
-			// TODO Probably should cancel all rendering here.
-		}
+void desktop_frame_ended(desktop_t* d, uint64_t cpu_time) {
+	if (d->pose_time != 0) {
+		d->stats.pose_latency = clock_now() - d->pose_time;
 	}
 
-	free(views);
+	d->pose_time = 0;
 
-	// Fill in composition layer.
+	// Feed the quality governor if we rendered anything.
+	// GPU time is only taken into account once the resolution governor can't bring it down any further, as lowering the resolution is much less noticeable than any of the quality levers.
 
-	layer->type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
-	layer->next = NULL;
+	if (d->display_period == 0) {
+		return;
+	}
 
-	layer->layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_CORRECT_CHROMATIC_ABERRATION_BIT;
-	layer->space = space;
+	uint64_t frame_time = cpu_time;
 
-	layer->viewCount = d->view_count;
-	layer->views = *layer_views;
+	if (d->res_gov.scale <= RES_GOV_MIN_SCALE && d->stats.gpu_time > frame_time) {
+		frame_time = d->stats.gpu_time;
+	}
 
-	return 0;
+	quality_update(d, frame_time);
+	d->display_period = 0;
 }
 
 void desktop_send_win(
@@ -476,6 +1640,13 @@ void desktop_send_win(
 	win->y_res = 0;
 	win->created = false;
 	win->destroyed = false;
+	win->swapchain.swapchain = XR_NULL_HANDLE;
+	win->layer_ready = false;
+	win->own_layer = false;
+	win->tiles_x = 0;
+	win->tiles_y = 0;
+	win->translucent_tiles = NULL;
+	win->translucent_tile_count = 0;
 
 found:
 
@@ -486,6 +1657,26 @@ found:
 
 		win->x_res = x_res;
 		win->y_res = y_res;
+
+		win->tiles_x = 0; // Force tile tracking to be reset below.
+	}
+
+	// Keep track of which tiles have any translucent pixels in them, so we know which windows are opaque.
+	// Until a tile has been sent, we don't know what's in it, so it's assumed to be translucent.
+
+	if (tiles_x != win->tiles_x || tiles_y != win->tiles_y) {
+		size_t const tile_count = tiles_x * tiles_y;
+		size_t const word_count = (tile_count + 63) / 64;
+
+		free(win->translucent_tiles);
+		win->translucent_tiles = malloc(word_count * sizeof *win->translucent_tiles);
+		assert(win->translucent_tiles != NULL);
+
+		memset(win->translucent_tiles, 0xFF, word_count * sizeof *win->translucent_tiles);
+
+		win->tiles_x = tiles_x;
+		win->tiles_y = tiles_y;
+		win->translucent_tile_count = tile_count;
 	}
 
 	uint32_t const tile_x_res = x_res / tiles_x;
@@ -502,15 +1693,30 @@ found:
 				continue;
 			}
 
+			uint32_t alpha = 0xFF000000; // Pixels are BGRA, so alpha is the top byte.
+
 			for (size_t y = tile_y_res * i; y < tile_y_res * (i + 1); y++) {
 				for (size_t x = tile_x_res * j; x < tile_x_res * (j + 1); x++) {
-					((uint32_t*) win->fb_data)[y * x_res + x] = *((uint32_t*) (tile_data + counter));
+					uint32_t const pixel = *((uint32_t*) (tile_data + counter));
+
+					((uint32_t*) win->fb_data)[y * x_res + x] = pixel;
+					alpha &= pixel;
 					counter += 4;
 				}
 			}
+
+			uint64_t* const word = &win->translucent_tiles[tile_index / 64];
+			uint64_t const bit = 1ull << (tile_index % 64);
+			bool const translucent = alpha != 0xFF000000;
+
+			if (translucent != !!(*word & bit)) {
+				*word ^= bit;
+				win->translucent_tile_count += translucent ? 1 : -1;
+			}
 		}
 	}
 
+	win->dirty = true;
 	pthread_mutex_unlock(&d->win_mutex);
 }
 
@@ -533,6 +1739,7 @@ void desktop_destroy_win(uint32_t id) {
 	}
 
 	LOGE("This shouldn't happen.");
+	pthread_mutex_unlock(&d->win_mutex);
 	return;
 
 found:
@@ -1,7 +1,17 @@
 #pragma once
 
+#include "arena.h"
 #include "env.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "matrix.h"
 #include "platform.h"
+#include "quality_gov.h"
+#include "render_pass.h"
+#include "res_gov.h"
+#include "shader.h"
+#include "swapchain.h"
+#include "ubo_ring.h"
 #include "win.h"
 
 #include <jni.h>
@@ -16,55 +26,212 @@
 #include <openxr/openxr_platform.h>
 
 typedef struct {
-	XrSwapchain swapchain;
+	// Submit each window as its own composition layer (quad or cylinder) rather than rasterizing it into the projection layer.
+	// Window layers are then only ever written to when their contents change.
 
-	uint32_t x_res;
-	uint32_t y_res;
+	bool win_layers;
 
-	size_t image_count;
-	GLuint* fbos;
-} swapchain_t;
+	// How many windows can be submitted as their own layers before we hit the runtime's layer limit.
+	// Any past that are drawn into the projection layer as if window layers were off.
+
+	size_t max_win_layers;
+
+	// Whether XR_KHR_composition_layer_cylinder is enabled, in which case window layers are curved like the windows themselves.
+
+	bool cylinder_layers;
+
+	// Refract the environment through the windows.
+	// When window layers are used, this is all the projection layer is still needed for.
+
+	bool refraction;
+
+	// Whether environments are created with a cubemap to refract (see mist_env_opts_t), which the refraction shader has to be built for.
+
+	bool env_cubemap;
+
+	// Whether XR_KHR_composition_layer_depth is enabled, in which case depth is submitted along with the projection layer.
+	// This lets the compositor reproject positionally (rather than just rotationally) when we miss a frame.
+
+	bool depth;
+} desktop_opts_t;
+
+// Statistics for the last frame.
+// Window counts are per render pass, so each window is counted once per view without multiview.
+
+typedef struct {
+	size_t drawn;
+	size_t culled;
+
+	// Last GPU time of the projection layer passes (in nanoseconds) and the render scale the resolution governor picked.
+
+	uint64_t gpu_time;
+	float render_scale;
+
+	// State changes which went through the GL state cache since the last frame.
+
+	gl_state_stats_t gl;
+
+	// How long into the frame views were located again before drawing (i.e. how stale they'd otherwise have been), and how long it was from then until xrEndFrame returned for the last submitted frame.
+
+	uint64_t latch_delay;
+	uint64_t pose_latency;
+} desktop_stats_t;
+
+// Variants of the window shader, from cheapest to most expensive.
+
+typedef enum {
+	WIN_VARIANT_OPAQUE,
+	WIN_VARIANT_TRANSLUCENT,
+	WIN_VARIANT_REFRACTION,
+	WIN_VARIANT_COUNT,
+} win_variant_t;
+
+typedef union {
+	XrCompositionLayerBaseHeader base;
+	XrCompositionLayerQuad quad;
+	XrCompositionLayerCylinderKHR cylinder;
+} win_layer_t;
 
 typedef struct {
 	XrSession sesh;
 	mist_env_t* env;
+	desktop_opts_t opts;
+
 	platform_t plat;
+	matrix_t plat_model;
+
+	// Predicted display time of the last frame, used to advance animations.
+
+	XrTime last_display_time;
+
+	desktop_stats_t stats;
+	XrTime last_stats_time;
+
+	// When we started rendering the current frame and when the poses we're drawing it with were sampled, on the monotonic clock (see clock.h).
+	// The latter is 0 if the frame isn't drawn with any poses.
+
+	uint64_t frame_start_time;
+	uint64_t pose_time;
+
+	// Display period of the frame being rendered, or 0 once it's been submitted.
+
+	XrDuration display_period;
 
 	pthread_mutex_t win_mutex;
 	size_t win_count;
 	win_t* wins;
 
-	// TODO A swapchain for each view. Actually make this a list because we could have 1 or 2.
-	// TODO Do we need a depth swapchain even?
+	// With multiview, there's a single swapchain with an array layer for each view.
+	// Otherwise, there's a swapchain for each view.
+	// Each of these has a matching depth swapchain if we're submitting depth.
 
 	size_t view_count;
+	bool multiview;
+	uint32_t msaa_samples;
+	size_t swapchain_count;
 	swapchain_t* swapchains;
+	swapchain_t* depth_swapchains;
+
+	render_pass_t const* projection_pass;
+
+	// Uniform blocks for the current frame.
+	// There's a 'frame' block for each swapchain, and a 'win' block for each window (see win_t::ubo_offset).
+
+	ubo_ring_t ubo_ring;
+	GLintptr* frame_ubo_offsets;
+
+	// The projection layer is rendered to a smaller part of its swapchains when the GPU can't keep up.
+
+	gpu_timer_t gpu_timer;
+	res_gov_t res_gov;
+
+	// When that's not enough, quality levers are pulled (see quality_gov.h).
+	// The window we're focused on is the one whose contents keep being uploaded every frame regardless.
+
+	quality_gov_t quality_gov;
+	size_t frame_index;
+	uint32_t focused_win;
+
+	// Layers we submit each frame.
+	// These are owned by the desktop rather than the windows, as the window list can be reallocated from under us by desktop_send_win.
+
+	XrCompositionLayerProjection layer;
+	XrCompositionLayerProjectionView* layer_views;
+	XrCompositionLayerDepthInfoKHR* depth_infos;
+
+	size_t win_layer_count;
+	size_t win_layer_cap;
+	win_layer_t* win_layers;
+
+	// Windows which didn't fit in the layer limit this frame (see desktop_opts_t::max_win_layers).
+
+	size_t overflow_win_count;
+
+	size_t layer_count;
+	XrCompositionLayerBaseHeader const** layers;
 
-	GLuint win_shader;
-	GLuint win_model_uniform;
-	GLuint win_view_uniform;
-	GLuint win_proj_uniform;
-	GLuint win_camera_pos_uniform;
-	GLuint win_env_sampler_uniform;
-	GLuint win_sampler_uniform;
+	// Fully transparent texture bound in place of window contents when those are drawn as their own layers.
+
+	GLuint clear_tex;
+
+	// Shader for copying window contents to their swapchains.
+
+	GLuint copy_shader;
+	GLuint copy_sampler_uniform;
+
+	// Window shader variants which are needed with our options are built up front; the others are left as 0.
+	// These, along with the copy shader, are compiled in the background from desktop_create on, and we only start rendering once they're all ready.
+
+	uint64_t shaders_start;
+	bool shaders_ready;
+	bool shaders_failed;
+
+	bool win_shader_submitted[WIN_VARIANT_COUNT];
+	shader_job_t win_shader_jobs[WIN_VARIANT_COUNT];
+
+	bool copy_shader_submitted;
+	shader_job_t copy_shader_job;
+
+	GLuint win_shaders[WIN_VARIANT_COUNT];
+	GLint win_env_lod_uniform;
+	float win_env_lod; // Last value set for win_env_lod_uniform.
 } desktop_t;
 
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
-int desktop_create(desktop_t* d, XrSession sesh, size_t view_count, XrViewConfigurationView* views, mist_env_t* env);
+int desktop_create(
+	desktop_t* d,
+	XrSession sesh,
+	size_t view_count,
+	XrViewConfigurationView* views,
+	mist_env_t* env,
+	desktop_opts_t const* opts
+);
+
 void desktop_destroy(desktop_t* d);
 
+// Render the desktop and return the composition layers to submit for it, in order.
+// These remain valid until the next call.
+// Transient data for the frame is allocated from 'arena'.
+
 int desktop_render(
 	desktop_t* d,
+	arena_t* arena,
 	XrSpace space,
 	XrViewConfigurationType view_config,
 	XrTime predicted_display_time,
-	XrCompositionLayerProjection* layer,
-	XrCompositionLayerProjectionView** layer_views
+	XrDuration predicted_display_period,
+	size_t* layer_count,
+	XrCompositionLayerBaseHeader const* const** layers
 );
 
+// Call once xrEndFrame has returned for a frame rendered with desktop_render, to measure how old the poses it was drawn with are by the time it's submitted.
+// 'cpu_time' is how long the whole frame took on the CPU, which is used to decide what quality to render the next ones at.
+
+void desktop_frame_ended(desktop_t* d, uint64_t cpu_time);
+
 void desktop_send_win(
 	uint32_t id,
 	uint32_t x_res,
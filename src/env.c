@@ -1,6 +1,13 @@
 #include "env.h"
 
+#include "asset.h"
+#include "clock.h"
+#include "gl_state.h"
+#include "ktx2.h"
 #include "log.h"
+#include "render_pass.h"
+#include "shader.h"
+#include "swapchain.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -9,212 +16,931 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-int mist_env_render(mist_env_t* env, XrSpace space, XrCompositionLayerEquirect2KHR* layer) {
-	// Configure composition layer.
-	// TODO Can this just be done on init?
+// The blurred map starts at half the resolution of the sharp one, and each mip level is blurred further until it's this small (as an equirectangular map).
 
-	layer->next = NULL;
-	layer->subImage.imageArrayIndex = 0;
-	layer->type = XR_TYPE_COMPOSITION_LAYER_EQUIRECT2_KHR;
-	layer->layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_CORRECT_CHROMATIC_ABERRATION_BIT;
+#define BLUR_MIN_RES 8
 
-	layer->space = space;
-	layer->eyeVisibility = XR_EYE_VISIBILITY_BOTH;
-	layer->radius = 0;
-	layer->centralHorizontalAngle = 2 * M_PI; // TODO Fix black line.
-	layer->upperVerticalAngle = M_PI_2;
-	layer->lowerVerticalAngle = -M_PI_2;
+// Number of rows of a decoded equirectangular map to upload at a time when creating an environment in steps.
+// At 2048 pixels wide, this is 1 MiB.
 
-	layer->subImage.swapchain = env->equirect_swapchain;
+#define UPLOAD_ROWS 128
 
-	// clang-format off
-	layer->pose = (XrPosef) {{0, 0, 0, 1}, {0, 0, 0}};
+// Largest width of the equirectangular map loaded for previews.
+// This is small enough that creating an environment from it takes no time no matter how large the full map is.
 
-	layer->subImage.imageRect = (XrRect2Di) {
-		.offset = {0, 0},
-		.extent = {(int32_t) env->equirect_x_res, (int32_t) env->equirect_y_res},
-	};
-	// clang-format on
+#define PREVIEW_RES 256
 
-	// Acquire swapchain.
+// Stages of creating an environment (see mist_env_create_step).
 
-	uint32_t image_index = 0;
-	XrSwapchainImageAcquireInfo acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+enum {
+	STAGE_JOIN,
+	STAGE_SHADERS,
+	STAGE_EQUIRECT,
+	STAGE_UPLOAD,
+	STAGE_BLUR,
+	STAGE_CUBE,
+	STAGE_DONE,
+};
 
-	if (xrAcquireSwapchainImage(env->equirect_swapchain, &acquire_info, &image_index) != XR_SUCCESS) {
-		LOGE("Failed to acquire swapchain.");
-		return -1;
-	}
+// Pass for all the fullscreen draws environments are created with (decompressing the equirectangular map into its swapchain images, blurring it and converting it to a cubemap), every texel of which is written.
 
-	XrSwapchainImageWaitInfo wait_info = {
-		.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
-		.timeout = XR_INFINITE_DURATION,
-	};
+static render_pass_t const WRITE_PASS = {
+	.name = "environment write",
+	.attachment_count = 1,
+	.attachments = {
+		{GL_COLOR_ATTACHMENT0, RENDER_PASS_DONT_CARE, RENDER_PASS_STORE},
+	},
+};
 
-	int rv = 0;
+#define MULTILINE(...) #__VA_ARGS__
+#pragma clang diagnostic ignored "-Wunknown-escape-sequence"
 
-	if (xrWaitSwapchainImage(env->equirect_swapchain, &wait_info) != XR_SUCCESS) {
-		LOGE("Failed to wait for swapchain.");
-		rv = -1;
-	}
+// Fullscreen triangle, generated from the vertex ID so no buffers are needed.
 
-	XrSwapchainImageReleaseInfo release_info = {XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+// clang-format off
+static char const* const FULLSCREEN_VERT_SRC = MULTILINE(
+\#version 310 es\n
+precision highp float;
 
-	if (xrReleaseSwapchainImage(env->equirect_swapchain, &release_info) != XR_SUCCESS) {
-		LOGE("Failed to release swapchain.");
+out vec2 tex_coord;
+
+void main() {
+	vec2 pos = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+	tex_coord = (pos + 1.0) / 2.0;
+	gl_Position = vec4(pos, 0.0, 1.0);
+}
+);
+
+// Copies a texture to the whole framebuffer.
+
+static char const* const DECOMPRESS_SHADER_FRAG_SRC = MULTILINE(
+\#version 310 es\n
+precision highp float;
+
+in vec2 tex_coord;
+
+uniform sampler2D tex;
+
+out vec4 frag_colour;
+
+void main() {
+	frag_colour = texture(tex, tex_coord);
+}
+);
+
+// Samples a level of an equirectangular map into a face of a cubemap.
+// Face directions are from the cubemap table of the GLES spec (section 8.13), and the equirectangular mapping is the one windows used to sample it with directly.
+
+static char const* const CUBE_SHADER_FRAG_SRC = MULTILINE(
+\#version 310 es\n
+precision highp float;
+
+in vec2 tex_coord;
+
+uniform sampler2D tex;
+uniform float lod;
+uniform int face;
+
+out vec4 frag_colour;
+
+const float PI = 3.14159265359;
+
+vec3 face_dir(vec2 st) {
+	switch (face) {
+	case 0: return vec3(1.0, -st.y, -st.x);
+	case 1: return vec3(-1.0, -st.y, st.x);
+	case 2: return vec3(st.x, 1.0, st.y);
+	case 3: return vec3(st.x, -1.0, -st.y);
+	case 4: return vec3(st.x, -st.y, 1.0);
+	default: return vec3(-st.x, -st.y, -1.0);
 	}
+}
 
-	return rv;
+vec2 dir_to_equirect(vec3 dir) {
+	float lon = atan(dir.z, dir.x) + PI / 2.0;
+	float lat = asin(clamp(dir.y, -1.0, 1.0));
+	return vec2(lon / (2.0 * PI) + 0.5, lat / PI + 0.5);
 }
 
-static void* read_image(AAssetManager* mgr, char* path, uint32_t* x_res, uint32_t* y_res) {
-	void* buf = NULL;
+void main() {
+	vec3 dir = normalize(face_dir(tex_coord * 2.0 - 1.0));
+	frag_colour = textureLod(tex, dir_to_equirect(dir), lod);
+}
+);
 
-	// Open asset for equirectangular map.
+// One direction of a separable gaussian blur over a level of a texture.
+// This is the 9-tap kernel, but sampling between texels so that bilinear filtering does half the work for us.
+// The horizontal pass of each level is drawn at half the resolution of its source, so bilinear filtering also averages 2x2 texels down into each of its texels.
 
-	AAsset* const asset = AAssetManager_open(mgr, path, AASSET_MODE_STREAMING);
+static char const* const BLUR_SHADER_FRAG_SRC = MULTILINE(
+\#version 310 es\n
+precision highp float;
 
-	if (asset == NULL) {
-		LOGE("Could not load asset %s.", path);
-		goto err_load_asset;
+in vec2 tex_coord;
+
+uniform sampler2D tex;
+uniform float lod;
+uniform vec2 step;
+
+out vec4 frag_colour;
+
+const float OFFSETS[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float WEIGHTS[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main() {
+	frag_colour = textureLod(tex, tex_coord, lod) * WEIGHTS[0];
+
+	for (int i = 1; i < 3; i++) {
+		frag_colour += textureLod(tex, tex_coord + step * OFFSETS[i], lod) * WEIGHTS[i];
+		frag_colour += textureLod(tex, tex_coord - step * OFFSETS[i], lod) * WEIGHTS[i];
 	}
+}
+);
+// clang-format on
+
+static struct {
+	char const* name;
+	char const* frag_src;
+} const SHADERS[MIST_ENV_SHADER_COUNT] = {
+	[MIST_ENV_SHADER_DECOMPRESS] = {"decompression", DECOMPRESS_SHADER_FRAG_SRC},
+	[MIST_ENV_SHADER_BLUR] = {"blur", BLUR_SHADER_FRAG_SRC},
+	[MIST_ENV_SHADER_CUBE] = {"cubemap", CUBE_SHADER_FRAG_SRC},
+};
+
+// Set up the composition layer for the environment, which is the same every frame.
+
+static void init_layer(mist_env_t* env, XrSpace space) {
+	env->layer = (XrCompositionLayerEquirect2KHR) {
+		.type = XR_TYPE_COMPOSITION_LAYER_EQUIRECT2_KHR,
+		.next = NULL,
+		.layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_CORRECT_CHROMATIC_ABERRATION_BIT,
+		.space = space,
+		.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+		.subImage = {
+			.swapchain = env->equirect_swapchain,
+			.imageRect = {
+				.offset = {0, 0},
+				.extent = {(int32_t) env->equirect_x_res, (int32_t) env->equirect_y_res},
+			},
+			.imageArrayIndex = 0,
+		},
+		.pose = {{0, 0, 0, 1}, {0, 0, 0}},
+		.radius = 0,
+		.centralHorizontalAngle = 2 * M_PI, // TODO Fix black line.
+		.upperVerticalAngle = M_PI_2,
+		.lowerVerticalAngle = -M_PI_2,
+	};
+}
 
-	// Read asset contents.
+// Read and decode a PNG asset.
+// The decoder reads straight from the asset's mapping, so the only copy we make is the decoded image.
+// 'read_time' is set to when it was mapped, for the startup timeline.
 
-	off_t const asset_size = AAsset_getLength(asset);
-	void* const asset_buf = malloc(asset_size);
-	assert(asset_buf != NULL);
+static void* read_image(AAssetManager* mgr, char const* path, uint32_t* x_res, uint32_t* y_res, uint64_t* read_time) {
+	asset_map_t map;
 
-	if (AAsset_read(asset, asset_buf, asset_size) < 0) {
-		LOGE("Could not read %s.", path);
-		goto err_read_asset;
+	if (asset_map(&map, mgr, path) < 0) {
+		LOGE("Could not load asset %s.", path);
+		return NULL;
 	}
 
+	*read_time = clock_now();
+
 	// Decode image from memory.
+	// This can happen on several threads at once, so the flip flag has to be set for this one only.
 
-	stbi_set_flip_vertically_on_load(true);
+	stbi_set_flip_vertically_on_load_thread(true);
 
 	int channels;
-	buf = stbi_load_from_memory(asset_buf, asset_size, (int*) x_res, (int*) y_res, &channels, STBI_rgb_alpha);
+	void* const buf = stbi_load_from_memory(map.data, map.size, (int*) x_res, (int*) y_res, &channels, STBI_rgb_alpha);
 
 	if (buf == NULL) {
 		LOGE("Failed to decode image %s.", path);
-		goto err_decode;
 	}
 
-err_decode:
-err_read_asset:
-
-	free(asset_buf);
-	AAsset_close(asset);
-
-err_load_asset:
-
+	asset_unmap(&map);
 	return buf;
 }
 
-int mist_env_create(mist_env_t* env, XrSession session, AAssetManager* mgr, char const* name) {
-	int rv = -1;
+// Map the KTX2 version of an environment image, if there is one we can use.
+// It's kept mapped in 'map' until the caller is done uploading, as the texture's levels point straight into it.
+// Whether the GPU can sample its format is left to the caller, as GL might not be loaded yet.
 
-	// Read equirectangular map.
+static int read_ktx2(AAssetManager* mgr, char const* path, asset_map_t* map, ktx2_t* ktx) {
+	if (asset_map(map, mgr, path) < 0) {
+		return -1;
+	}
 
-	char asset_path[256];
-	snprintf(asset_path, sizeof asset_path, "envs/%s/equirectangle.png", name);
-	void* const buf = read_image(mgr, asset_path, &env->equirect_x_res, &env->equirect_y_res);
+	if (ktx2_parse(ktx, map->data, map->size) < 0) {
+		LOGE("Could not parse %s.", path);
+		asset_unmap(map);
 
-	if (buf == NULL) {
-		goto err_equirect_read;
+		return -1;
 	}
 
-	// Read blurred equirectangular map.
+	return 0;
+}
 
-	snprintf(asset_path, sizeof asset_path, "envs/%s/equirectangle_blur.png", name);
-	void* const blur_buf = read_image(mgr, asset_path, &env->blur_equirect_x_res, &env->blur_equirect_y_res);
+// Start a KTX2 texture at its largest mip which is no wider than PREVIEW_RES, if it has one.
 
-	if (buf == NULL) {
-		goto err_blur_equirect_read;
+static int ktx2_preview(ktx2_t* ktx) {
+	uint32_t skip = 0;
+
+	while (ktx->x_res >> skip > PREVIEW_RES && skip + 1 < ktx->level_count) {
+		skip++;
 	}
 
-	// Create blurred equirectangular map texture.
+	if (ktx->x_res >> skip > PREVIEW_RES) {
+		return -1;
+	}
 
-	glGenTextures(1, &env->blur_equirect_tex);
-	glBindTexture(GL_TEXTURE_2D, env->blur_equirect_tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, env->blur_equirect_x_res, env->blur_equirect_y_res, 0, GL_RGBA, GL_UNSIGNED_BYTE, blur_buf);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	ktx2_skip_levels(ktx, skip);
+	return 0;
+}
 
-	// Create swapchain.
+// Path of the PNG version of an environment's equirectangular map.
+// Previews of environments which aren't compressed (or which don't have mips) come from a separate, smaller PNG.
 
+static void png_path(mist_env_load_t const* load, char* path, size_t size) {
+	snprintf(path, size, "envs/%s/equirectangle%s.png", load->name, load->opts.preview ? "_preview" : "");
+}
+
+// Create the swapchain for the equirectangular map and get its images, which the caller must free.
+// The map never changes, so this is a static swapchain: it only has the one image, which is acquired here and only released once it's been written, after which the compositor keeps using it without us having to acquire it every frame.
+
+static GLuint* create_swapchain(mist_env_t* env, XrSession session, int64_t format, uint32_t mip_count, XrSwapchainUsageFlags usage, uint32_t* image_count) {
 	XrSwapchainCreateInfo const swapchain_create = {
 		.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
-		.createFlags = 0,
-		.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
-		.format = GL_RGBA8,
+		.createFlags = XR_SWAPCHAIN_CREATE_STATIC_IMAGE_BIT,
+		.usageFlags = usage,
+		.format = format,
 		.sampleCount = 1,
 		.width = env->equirect_x_res,
 		.height = env->equirect_y_res,
 		.faceCount = 1,
 		.arraySize = 1,
-		.mipCount = 1,
+		.mipCount = mip_count,
 	};
 
 	if (xrCreateSwapchain(session, &swapchain_create, &env->equirect_swapchain) != XR_SUCCESS) {
-		LOGE("Failed to create swapchain for %s.", name);
-		goto err_create_swapchain;
+		LOGE("Failed to create swapchain.");
+		return NULL;
 	}
 
-	// Get swapchain images.
+	if (xrEnumerateSwapchainImages(env->equirect_swapchain, 0, image_count, NULL) != XR_SUCCESS) {
+		LOGE("Failed to enumerate swapchain images.");
+		goto err_enum_images;
+	}
 
-	uint32_t image_count;
+	XrSwapchainImageOpenGLESKHR* const xr_images = calloc(*image_count, sizeof *xr_images);
+	assert(xr_images != NULL);
 
-	if (xrEnumerateSwapchainImages(env->equirect_swapchain, 0, &image_count, NULL) != XR_SUCCESS) {
-		LOGE("Failed to enumerate swapchain images for %s.", name);
+	for (size_t i = 0; i < *image_count; i++) {
+		xr_images[i].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
+	}
+
+	if (xrEnumerateSwapchainImages(env->equirect_swapchain, *image_count, image_count, (XrSwapchainImageBaseHeader*) xr_images) != XR_SUCCESS) {
+		LOGE("Failed to enumerate swapchain images.");
+		free(xr_images);
 		goto err_enum_images;
 	}
 
-	XrSwapchainImageOpenGLESKHR* const images = calloc(image_count, sizeof *images);
+	GLuint* const images = calloc(*image_count, sizeof *images);
 	assert(images != NULL);
 
-	for (size_t i = 0; i < image_count; i++) {
-		images[i].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
+	for (size_t i = 0; i < *image_count; i++) {
+		images[i] = (GLuint) xr_images[i].image;
 	}
 
-	if (xrEnumerateSwapchainImages(env->equirect_swapchain, image_count, &image_count, (XrSwapchainImageBaseHeader*) images) != XR_SUCCESS) {
-		LOGE("Failed to enumerate swapchain images for %s.", name);
-		goto err_enum_images2;
+	free(xr_images);
+
+	// Acquire the image so we can write it.
+
+	uint32_t image_index;
+	XrSwapchainImageAcquireInfo const acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+
+	if (xrAcquireSwapchainImage(env->equirect_swapchain, &acquire_info, &image_index) != XR_SUCCESS) {
+		LOGE("Failed to acquire swapchain.");
+		free(images);
+		goto err_enum_images;
 	}
 
-	// Write texture to each swapchain image.
+	XrSwapchainImageWaitInfo const wait_info = {
+		.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
+		.timeout = XR_INFINITE_DURATION,
+	};
+
+	if (xrWaitSwapchainImage(env->equirect_swapchain, &wait_info) != XR_SUCCESS) {
+		LOGE("Failed to wait for swapchain.");
+		free(images);
+		goto err_enum_images;
+	}
+
+	return images;
+
+err_enum_images:
+
+	xrDestroySwapchain(env->equirect_swapchain);
+	return NULL;
+}
+
+// Whether a compressed equirectangular map has to be decompressed on the GPU (see write_ktx2).
+// This needs GL to be loaded, so it can only be called on the render thread.
+
+static bool needs_decompress(XrSession session, mist_env_load_t const* load) {
+	return load->compressed && ktx2_format_supported(load->ktx.format) && !swapchain_format_supported(session, load->ktx.format);
+}
+
+// Write a compressed equirectangular map to its swapchain.
+// If the runtime can take the compressed format directly, the swapchain is created in it and its levels are copied as-is.
+// Otherwise, it's uploaded to a texture first and decompressed into an uncompressed swapchain by drawing it with 'decompress_shader' (the GPU decodes it when sampling), which at least saves us the PNG decode.
+// That shader is only given in the second case (see needs_decompress).
+
+static int write_ktx2(mist_env_t* env, XrSession session, ktx2_t const* ktx, GLuint decompress_shader) {
+	uint32_t image_count;
+	GLuint* images;
+
+	if (decompress_shader == 0) {
+		images = create_swapchain(env, session, ktx->format, ktx->level_count, XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT, &image_count);
+
+		if (images == NULL) {
+			return -1;
+		}
+
+		for (size_t i = 0; i < image_count; i++) {
+			env->equirect_tex = images[i];
+			gl_state_bind_texture(0, env->equirect_tex);
+			ktx2_tex_sub_image(ktx, GL_TEXTURE_2D);
+		}
+
+		free(images);
+		return 0;
+	}
+
+	LOGI("Runtime can't create swapchains in format 0x%x, decompressing environment on the GPU.", ktx->format);
+	images = create_swapchain(env, session, GL_RGBA8, 1, XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT, &image_count);
+
+	if (images == NULL) {
+		return -1;
+	}
+
+	GLuint tex;
+	glGenTextures(1, &tex);
+	gl_state_bind_texture(0, tex);
+	ktx2_tex_image(ktx, GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	gl_state_use_program(decompress_shader);
+	glUniform1i(glGetUniformLocation(decompress_shader, "tex"), 0);
+	gl_state_bind_vertex_array(0);
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
 
 	for (size_t i = 0; i < image_count; i++) {
-		env->equirect_tex = (GLuint) images[i].image;
-		glBindTexture(GL_TEXTURE_2D, env->equirect_tex);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, env->equirect_x_res, env->equirect_y_res, GL_RGBA, GL_UNSIGNED_BYTE, buf);
+		env->equirect_tex = images[i];
+
+		gl_state_bind_framebuffer(fbo);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, env->equirect_tex, 0);
+
+		render_pass_begin(&WRITE_PASS, fbo, env->equirect_x_res, env->equirect_y_res);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		render_pass_end(&WRITE_PASS);
 	}
 
-	// Cleanup.
+	// Unbind everything before deleting it, so the GL state cache doesn't think any of it is still bound.
 
-	rv = 0;
+	gl_state_bind_framebuffer(0);
+	glDeleteFramebuffers(1, &fbo);
 
-err_enum_images2:
+	gl_state_bind_texture(0, 0);
+	glDeleteTextures(1, &tex);
 
 	free(images);
+	return 0;
+}
 
-err_enum_images:
+// Create the swapchain for the (sharp) equirectangular map, which is what's submitted as the environment layer.
+// Returns 1 if its contents were written too, which is only the case for KTX2 textures.
 
-	if (rv != 0) {
-		xrDestroySwapchain(env->equirect_swapchain);
+static int create_equirect(mist_env_t* env, XrSession session, mist_env_load_t* load) {
+	if (load->compressed) {
+		if (ktx2_format_supported(load->ktx.format)) {
+			env->equirect_x_res = load->ktx.x_res;
+			env->equirect_y_res = load->ktx.y_res;
+
+			return write_ktx2(env, session, &load->ktx, load->shaders[MIST_ENV_SHADER_DECOMPRESS]) < 0 ? -1 : 1;
+		}
+
+		// This is a slow path for GPUs which can't sample the format we shipped, so we don't bother decoding the PNG in the background for them.
+
+		LOGW("Environment %s is in a format (0x%x) this GPU can't sample, falling back to PNG.", load->name, load->ktx.format);
+
+		char asset_path[256];
+		png_path(load, asset_path, sizeof asset_path);
+		load->buf = read_image(load->mgr, asset_path, &load->x_res, &load->y_res, &load->read_time);
+
+		if (load->buf == NULL) {
+			return -1;
+		}
 	}
 
-err_create_swapchain:
+	// The pixels themselves are uploaded a few rows at a time afterwards (see STAGE_UPLOAD).
 
-	free(blur_buf);
+	env->equirect_x_res = load->x_res;
+	env->equirect_y_res = load->y_res;
+
+	uint32_t image_count;
+	GLuint* const images = create_swapchain(env, session, GL_RGBA8, 1, XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT, &image_count);
+
+	if (images == NULL) {
+		return -1;
+	}
+
+	env->equirect_tex = images[0];
+	free(images);
+
+	return 0;
+}
+
+// Draw one blur pass into a level of 'dst', from a level of 'src' (which must be a different texture).
+
+static void blur_pass(mist_env_load_t* load, GLuint dst, GLint dst_level, GLuint src, GLint src_level, float step_x, float step_y, GLsizei x_res, GLsizei y_res) {
+	gl_state_bind_framebuffer(load->fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, dst_level);
+
+	gl_state_bind_texture(0, src);
+	glUniform1f(load->lod_uniform, src_level);
+	glUniform2f(load->step_uniform, step_x, step_y);
+
+	render_pass_begin(&WRITE_PASS, load->fbo, x_res, y_res);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	render_pass_end(&WRITE_PASS);
+}
+
+// Set the sampling state used when blurring a texture.
+// Equirectangular maps wrap around horizontally but not vertically.
+
+static void blur_tex_params(GLuint tex, GLenum min_filter) {
+	gl_state_bind_texture(0, tex);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+// Set up for blurring the sharp equirectangular map into a mip chain (see STAGE_BLUR).
+// The blurred map starts at half the resolution of the sharp one.
+// Each cubemap face covers a quarter of its width, so they have the same texel density around the equator.
+
+static int blur_begin(mist_env_t* env, mist_env_load_t* load) {
+	load->blur_x_res = env->equirect_x_res / 2;
+	load->blur_y_res = env->equirect_y_res / 2;
+
+	if (load->blur_x_res < BLUR_MIN_RES || load->blur_y_res < BLUR_MIN_RES) {
+		LOGE("Environment is too small to blur (%ux%u).", env->equirect_x_res, env->equirect_y_res);
+		return -1;
+	}
+
+	env->blur_res = load->blur_x_res / 4;
+	env->blur_levels = 1;
+
+	while (load->blur_x_res >> env->blur_levels >= BLUR_MIN_RES && load->blur_y_res >> env->blur_levels >= BLUR_MIN_RES) {
+		env->blur_levels++;
+	}
+
+	GLuint const shader = load->shaders[MIST_ENV_SHADER_BLUR];
+
+	gl_state_use_program(shader);
+	glUniform1i(glGetUniformLocation(shader, "tex"), 0);
+
+	load->lod_uniform = glGetUniformLocation(shader, "lod");
+	load->step_uniform = glGetUniformLocation(shader, "step");
+
+	// The sharp map is a swapchain image, which we only ever read the first level of.
+
+	blur_tex_params(env->equirect_tex, GL_LINEAR);
+
+	glGenFramebuffers(1, &load->fbo);
+	glGenTextures(1, &load->scratch);
+	glGenTextures(1, &load->blurred);
+
+	GLuint const texs[] = {load->scratch, load->blurred};
+
+	for (size_t i = 0; i < sizeof texs / sizeof *texs; i++) {
+		gl_state_bind_texture(0, texs[i]);
+		glTexStorage2D(GL_TEXTURE_2D, env->blur_levels, GL_RGBA8, load->blur_x_res, load->blur_y_res);
+		blur_tex_params(texs[i], GL_LINEAR_MIPMAP_NEAREST);
+	}
+
+	return 0;
+}
 
-err_blur_equirect_read:
+// Blur one level of the mip chain.
+// Each mip level is blurred more than the last, so sampling it at a given LOD is like looking through glass of a given roughness.
+// Every level is a horizontal pass into the scratch texture followed by a vertical one back, each reading the previous level so that the blur accumulates while the kernel stays small.
 
-	free(buf);
+static void blur_level(mist_env_t* env, mist_env_load_t* load, uint32_t level) {
+	GLsizei const x_res = load->blur_x_res >> level;
+	GLsizei const y_res = load->blur_y_res >> level;
 
-err_equirect_read:
+	GLuint const src = level == 0 ? env->equirect_tex : load->blurred;
+	GLint const src_level = level == 0 ? 0 : level - 1;
+
+	gl_state_use_program(load->shaders[MIST_ENV_SHADER_BLUR]);
+	gl_state_bind_vertex_array(0);
+
+	blur_pass(load, load->scratch, level, src, src_level, 1. / x_res, 0, x_res, y_res);
+	blur_pass(load, load->blurred, level, load->scratch, level, 0, 1. / y_res, x_res, y_res);
+}
+
+// Set up for resampling each level of the blurred equirectangular map into the matching level of the cubemap (see STAGE_CUBE).
+
+static void cube_begin(mist_env_t* env, mist_env_load_t* load) {
+	GLuint const shader = load->shaders[MIST_ENV_SHADER_CUBE];
+
+	gl_state_use_program(shader);
+	glUniform1i(glGetUniformLocation(shader, "tex"), 0);
+
+	load->lod_uniform = glGetUniformLocation(shader, "lod");
+	load->face_uniform = glGetUniformLocation(shader, "face");
+
+	glGenTextures(1, &env->blur_tex);
+	gl_state_bind_texture_cube(0, env->blur_tex);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, env->blur_levels, GL_RGBA8, env->blur_res, env->blur_res);
+
+	// Windows sample whichever level their roughness calls for.
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+static void cube_level(mist_env_t* env, mist_env_load_t* load, uint32_t level) {
+	GLsizei const res = env->blur_res >> level;
+
+	gl_state_use_program(load->shaders[MIST_ENV_SHADER_CUBE]);
+	gl_state_bind_vertex_array(0);
+	gl_state_bind_texture(0, load->blurred);
+	gl_state_bind_framebuffer(load->fbo);
+
+	glUniform1f(load->lod_uniform, level);
+
+	for (int face = 0; face < 6; face++) {
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, env->blur_tex, level);
+		glUniform1i(load->face_uniform, face);
+
+		render_pass_begin(&WRITE_PASS, load->fbo, res, res);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		render_pass_end(&WRITE_PASS);
+	}
+}
+
+// Unbind the blurred map before deleting it, so the GL state cache doesn't think it's still bound.
+
+static void delete_blur_tex(mist_env_t* env) {
+	if (env->blur_tex == 0) {
+		return;
+	}
+
+	if (env->cubemap) {
+		gl_state_bind_texture_cube(0, 0);
+	}
+
+	else {
+		gl_state_bind_texture(0, 0);
+	}
+
+	glDeleteTextures(1, &env->blur_tex);
+	env->blur_tex = 0;
+}
+
+// Start compiling the shaders we need to create the environment from what was loaded.
+
+static void shaders_submit(XrSession session, mist_env_load_t* load) {
+	load->shader_submitted[MIST_ENV_SHADER_DECOMPRESS] = needs_decompress(session, load);
+	load->shader_submitted[MIST_ENV_SHADER_BLUR] = true;
+	load->shader_submitted[MIST_ENV_SHADER_CUBE] = load->opts.cubemap;
+
+	for (size_t i = 0; i < MIST_ENV_SHADER_COUNT; i++) {
+		load->shaders[i] = 0;
+
+		if (load->shader_submitted[i]) {
+			shader_submit(&load->shader_jobs[i], FULLSCREEN_VERT_SRC, SHADERS[i].frag_src, 0, NULL);
+		}
+	}
+}
+
+// Get the shaders once they're all ready.
+// Returns 1 once they are, 0 if they're not yet, and -1 if any failed.
+
+static int shaders_finish(mist_env_load_t* load) {
+	for (size_t i = 0; i < MIST_ENV_SHADER_COUNT; i++) {
+		if (load->shader_submitted[i] && !shader_ready(&load->shader_jobs[i])) {
+			return 0;
+		}
+	}
+
+	int rv = 1;
+
+	for (size_t i = 0; i < MIST_ENV_SHADER_COUNT; i++) {
+		if (!load->shader_submitted[i]) {
+			continue;
+		}
+
+		load->shaders[i] = shader_finish(&load->shader_jobs[i]);
+		load->shader_submitted[i] = false;
+
+		if (load->shaders[i] == 0) {
+			LOGE("Failed to create %s shader for environment %s.", SHADERS[i].name, load->name);
+			rv = -1;
+		}
+	}
+
+	return rv;
+}
+
+// Free everything which was only needed to create the environment.
+// Everything's been uploaded (or failed to be) by now, so we don't need what was loaded anymore either.
+// Objects are unbound before being deleted, so the GL state cache doesn't think any of them are still bound.
+
+static void load_cleanup(mist_env_load_t* load) {
+	if (load->fbo != 0) {
+		gl_state_bind_framebuffer(0);
+		glDeleteFramebuffers(1, &load->fbo);
+		load->fbo = 0;
+	}
+
+	if (load->scratch != 0 || load->blurred != 0) {
+		gl_state_bind_texture(0, 0);
+
+		GLuint const texs[] = {load->scratch, load->blurred};
+		glDeleteTextures(2, texs);
+
+		load->scratch = 0;
+		load->blurred = 0;
+	}
+
+	for (size_t i = 0; i < MIST_ENV_SHADER_COUNT; i++) {
+		if (load->shader_submitted[i]) {
+			shader_cancel(&load->shader_jobs[i]);
+			load->shader_submitted[i] = false;
+		}
+
+		if (load->shaders[i] != 0) {
+			gl_state_use_program(0);
+			glDeleteProgram(load->shaders[i]);
+			load->shaders[i] = 0;
+		}
+	}
+
+	if (load->compressed) {
+		asset_unmap(&load->ktx_map);
+		load->compressed = false;
+	}
+
+	free(load->buf);
+	load->buf = NULL;
+}
+
+// Read and decode the equirectangular map, preferring the compressed version.
+// This is what runs on the worker thread.
+
+static void* load_thread(void* arg) {
+	mist_env_load_t* const load = arg;
+	char asset_path[256];
+
+	load->start_time = clock_now();
+
+	snprintf(asset_path, sizeof asset_path, "envs/%s/equirectangle.ktx2", load->name);
+	load->compressed = read_ktx2(load->mgr, asset_path, &load->ktx_map, &load->ktx) == 0;
+
+	if (load->compressed && load->opts.preview && ktx2_preview(&load->ktx) < 0) {
+		asset_unmap(&load->ktx_map);
+		load->compressed = false;
+	}
+
+	if (load->compressed) {
+		load->read_time = load->end_time = clock_now();
+		load->rv = 0;
+	}
+
+	else {
+		png_path(load, asset_path, sizeof asset_path);
+		load->buf = read_image(load->mgr, asset_path, &load->x_res, &load->y_res, &load->read_time);
+
+		load->end_time = clock_now();
+		load->rv = load->buf == NULL ? -1 : 0;
+	}
+
+	pthread_mutex_lock(&load->mutex);
+	load->done = true;
+	pthread_mutex_unlock(&load->mutex);
+
+	return NULL;
+}
+
+int mist_env_load(mist_env_load_t* load, AAssetManager* mgr, char const* name, mist_env_opts_t const* opts) {
+	*load = (mist_env_load_t) {
+		.mgr = mgr,
+		.opts = *opts,
+		.rv = -1,
+		.stage = STAGE_JOIN,
+	};
+
+	snprintf(load->name, sizeof load->name, "%s", name);
+	pthread_mutex_init(&load->mutex, NULL);
+
+	if (pthread_create(&load->thread, NULL, load_thread, load) != 0) {
+		LOGE("Failed to create thread for loading environment %s.", name);
+		pthread_mutex_destroy(&load->mutex);
+
+		return -1;
+	}
+
+	return 0;
+}
+
+bool mist_env_loaded(mist_env_load_t* load) {
+	pthread_mutex_lock(&load->mutex);
+	bool const done = load->done;
+	pthread_mutex_unlock(&load->mutex);
+
+	return done;
+}
+
+int mist_env_create_step(mist_env_t* env, XrSession session, XrSpace space, mist_env_load_t* load) {
+	int rv;
+
+	switch (load->stage) {
+	case STAGE_JOIN:
+		pthread_join(load->thread, NULL);
+		pthread_mutex_destroy(&load->mutex);
+		load->join_time = clock_now();
+
+		if (load->rv < 0) {
+			LOGE("Failed to load environment %s.", load->name);
+			goto err_load;
+		}
+
+		env->blur_tex = 0;
+		env->cubemap = load->opts.cubemap;
+
+		shaders_submit(session, load);
+		load->stage = STAGE_SHADERS;
+
+		return 0;
+
+	// Compiling and linking a shader can take longer than a frame, so wait for the driver to do it in the background rather than blocking on it.
+
+	case STAGE_SHADERS:
+		rv = shaders_finish(load);
+
+		if (rv < 0) {
+			goto err_load;
+		}
+
+		if (rv == 1) {
+			load->stage = STAGE_EQUIRECT;
+		}
+
+		return 0;
+
+	case STAGE_EQUIRECT:
+		rv = create_equirect(env, session, load);
+
+		if (rv < 0) {
+			LOGE("Failed to create swapchain for %s.", load->name);
+			goto err_load;
+		}
+
+		load->stage = rv == 1 ? STAGE_BLUR : STAGE_UPLOAD;
+		load->row = 0;
+		load->level = 0;
+
+		return 0;
+
+	case STAGE_UPLOAD:;
+		uint32_t const rows = env->equirect_y_res - load->row < UPLOAD_ROWS ? env->equirect_y_res - load->row : UPLOAD_ROWS;
+		uint8_t const* const pixels = (uint8_t const*) load->buf + (size_t) load->row * env->equirect_x_res * 4;
+
+		gl_state_bind_texture(0, env->equirect_tex);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load->row, env->equirect_x_res, rows, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+		load->row += rows;
+
+		if (load->row == env->equirect_y_res) {
+			load->stage = STAGE_BLUR;
+		}
+
+		return 0;
+
+	// The blurred map is generated from the swapchain image, so it has to be created before the image is released.
+
+	case STAGE_BLUR:
+		if (load->level == 0 && blur_begin(env, load) < 0) {
+			LOGE("Failed to create blurred texture for %s.", load->name);
+			goto err_swapchain;
+		}
+
+		blur_level(env, load, load->level++);
+
+		if (load->level < env->blur_levels) {
+			return 0;
+		}
+
+		if (env->cubemap) {
+			load->stage = STAGE_CUBE;
+			load->level = 0;
+
+			return 0;
+		}
+
+		// Without a cubemap, windows sample the blurred equirectangular map itself, at whichever level their roughness calls for.
+
+		env->blur_tex = load->blurred;
+		load->blurred = 0;
+
+		blur_tex_params(env->blur_tex, GL_LINEAR_MIPMAP_LINEAR);
+		break;
+
+	case STAGE_CUBE:
+		if (load->level == 0) {
+			cube_begin(env, load);
+		}
+
+		cube_level(env, load, load->level++);
+
+		if (load->level < env->blur_levels) {
+			return 0;
+		}
+
+		break;
+	}
+
+	// Everything's been written, so we can give the image to the compositor.
+
+	XrSwapchainImageReleaseInfo const release_info = {XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+
+	if (xrReleaseSwapchainImage(env->equirect_swapchain, &release_info) != XR_SUCCESS) {
+		LOGE("Failed to release swapchain for %s.", load->name);
+		goto err_release;
+	}
+
+	init_layer(env, space);
+	load_cleanup(load);
+	load->stage = STAGE_DONE;
+
+	return 1;
+
+err_release:
+
+	delete_blur_tex(env);
+
+err_swapchain:
+
+	xrDestroySwapchain(env->equirect_swapchain);
+
+err_load:
+
+	load_cleanup(load);
+	load->stage = STAGE_DONE;
+
+	return -1;
+}
+
+void mist_env_cancel(mist_env_t* env, mist_env_load_t* load) {
+	if (load->stage == STAGE_DONE) {
+		return;
+	}
+
+	if (load->stage == STAGE_JOIN) {
+		pthread_join(load->thread, NULL);
+		pthread_mutex_destroy(&load->mutex);
+	}
+
+	// The swapchain only exists once STAGE_EQUIRECT succeeded.
+
+	if (load->stage > STAGE_EQUIRECT) {
+		delete_blur_tex(env);
+		xrDestroySwapchain(env->equirect_swapchain);
+	}
+
+	load_cleanup(load);
+	load->stage = STAGE_DONE;
+}
+
+int mist_env_create(mist_env_t* env, XrSession session, XrSpace space, mist_env_load_t* load) {
+	int rv;
+
+	while ((rv = mist_env_create_step(env, session, space, load)) == 0);
 
 	return rv;
 }
+
+void mist_env_destroy(mist_env_t* env) {
+	delete_blur_tex(env);
+
+	xrDestroySwapchain(env->equirect_swapchain);
+}
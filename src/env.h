@@ -1,5 +1,11 @@
 #pragma once
 
+#include "asset.h"
+#include "ktx2.h"
+#include "shader.h"
+
+#include <pthread.h>
+
 #include <jni.h>
 
 #include <EGL/egl.h>
@@ -17,21 +23,131 @@ typedef struct {
 	uint32_t equirect_x_res;
 	uint32_t equirect_y_res;
 
-	uint32_t blur_equirect_x_res;
-	uint32_t blur_equirect_y_res;
+	// Blurred version of the map, which windows refract.
+	// It's generated from the sharp one as a mip chain which gets blurrier with each level.
+	// Sampling it at LOD 'roughness * (blur_levels - 1)' gives what the environment looks like through glass of that roughness (between 0 and 1).
+	// This is an equirectangular map, or a cubemap if 'cubemap' is set (see mist_env_opts_t).
+
+	bool cubemap;
+	uint32_t blur_res; // Of each face, if it's a cubemap.
+	uint32_t blur_levels;
 
 	GLuint equirect_tex;
-	GLuint blur_equirect_tex;
+	GLuint blur_tex;
+
+	// The environment is a static image, so the same layer is submitted every frame.
 
 	XrSwapchain equirect_swapchain;
+	XrCompositionLayerEquirect2KHR layer;
 } mist_env_t;
 
+typedef struct {
+	// Only load a low-resolution version of the environment, which is quick enough to show straight away while the full one is still loading.
+	// This is a small mip of its KTX2 texture, or else its 'equirectangle_preview.png', and loading fails if it has neither.
+
+	bool preview;
+
+	// Make the blurred map a cubemap, which can be sampled by direction directly rather than with the trigonometry an equirectangular map needs (and which doesn't waste texels at the poles).
+	// This is off by default until it's been shown to be faster on device (see scripts/bench_env.sh).
+
+	bool cubemap;
+} mist_env_opts_t;
+
+// Shaders environments are created with, which are compiled in the background while creating them.
+
+typedef enum {
+	MIST_ENV_SHADER_DECOMPRESS,
+	MIST_ENV_SHADER_BLUR,
+	MIST_ENV_SHADER_CUBE,
+	MIST_ENV_SHADER_COUNT,
+} mist_env_shader_t;
+
+// An environment's assets being read and decoded on a worker thread.
+// That's everything which doesn't need the GL context, so it can overlap with the rest of startup (or rendering) until the environment is created from it.
+
+typedef struct {
+	AAssetManager* mgr;
+	char name[64];
+	mist_env_opts_t opts;
+	pthread_t thread;
+
+	pthread_mutex_t mutex;
+	bool done;
+
+	// Results, which are only valid once joined.
+	// The equirectangular map is either a KTX2 texture pointing into its still mapped asset, or decoded pixels.
+
+	int rv;
+
+	bool compressed;
+	asset_map_t ktx_map;
+	ktx2_t ktx;
+
+	void* buf;
+	uint32_t x_res;
+	uint32_t y_res;
+
+	// When the worker started, was done mapping the asset, and was done decoding it, and when it was joined, on the monotonic clock (see clock.h).
+
+	uint64_t start_time;
+	uint64_t read_time;
+	uint64_t end_time;
+	uint64_t join_time;
+
+	// Progress creating the environment from what was loaded, and the GL objects only needed along the way.
+
+	int stage;
+	uint32_t row;
+	uint32_t level;
+
+	GLsizei blur_x_res;
+	GLsizei blur_y_res;
+
+	GLuint fbo;
+	GLuint scratch;
+	GLuint blurred;
+
+	// Only the shaders this environment needs are submitted; the others are left as 0.
+
+	bool shader_submitted[MIST_ENV_SHADER_COUNT];
+	shader_job_t shader_jobs[MIST_ENV_SHADER_COUNT];
+	GLuint shaders[MIST_ENV_SHADER_COUNT];
+
+	GLint lod_uniform;
+	GLint step_uniform;
+	GLint face_uniform;
+} mist_env_load_t;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
-int mist_env_create(mist_env_t* env, XrSession session, AAssetManager* mgr, char const* name);
-int mist_env_render(mist_env_t* env, XrSpace space, XrCompositionLayerEquirect2KHR* layer);
+// Start loading an environment.
+// This doesn't need the GL context and can be called as early as possible.
+
+int mist_env_load(mist_env_load_t* load, AAssetManager* mgr, char const* name, mist_env_opts_t const* opts);
+
+// Whether the worker is done loading, without blocking.
+
+bool mist_env_loaded(mist_env_load_t* load);
+
+// Do the next bit of creating an environment from what was loaded, each of which is short enough to fit alongside rendering a frame.
+// Returns 1 once it's created (at which point what was loaded is freed), 0 if there's more to do, and -1 if it failed.
+// The first step waits for the worker to be done loading, so check mist_env_loaded first to avoid blocking.
+// Shaders are compiled in the background, and steps do nothing but check on them until they're ready.
+// This must be called on the thread the GL context is current on.
+
+int mist_env_create_step(mist_env_t* env, XrSession session, XrSpace space, mist_env_load_t* load);
+
+// Give up on loading or creating an environment, freeing whatever's been done so far.
+// This waits for the worker if it's still loading, and does nothing if creating the environment already succeeded or failed.
+
+void mist_env_cancel(mist_env_t* env, mist_env_load_t* load);
+
+// Create an environment in one go, waiting for it to be done loading first.
+
+int mist_env_create(mist_env_t* env, XrSession session, XrSpace space, mist_env_load_t* load);
+void mist_env_destroy(mist_env_t* env);
 
 #if defined(__cplusplus)
 }
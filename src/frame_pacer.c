@@ -0,0 +1,219 @@
+#include "frame_pacer.h"
+#include "clock.h"
+#include "log.h"
+
+#include <time.h>
+
+void frame_pacer_create(frame_pacer_t* pacer) {
+	pacer->sesh = XR_NULL_HANDLE;
+	pacer->running = false;
+	pacer->ready = false;
+
+	pacer->last_display_time = 0;
+	pacer->begin_time = 0;
+	pacer->last_stats_time = 0;
+
+	pacer->frames = 0;
+	pacer->missed = 0;
+	pacer->cpu_time_total = 0;
+	pacer->cpu_time_max = 0;
+	pacer->gpu_time = 0;
+
+	pthread_mutex_init(&pacer->mutex, NULL);
+
+	// Timeouts are on the monotonic clock, so they're not thrown off by the wall clock changing.
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	pthread_cond_init(&pacer->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+void frame_pacer_destroy(frame_pacer_t* pacer) {
+	frame_pacer_stop(pacer);
+
+	pthread_cond_destroy(&pacer->cond);
+	pthread_mutex_destroy(&pacer->mutex);
+}
+
+static void* frame_pacer_thread(void* arg) {
+	frame_pacer_t* const pacer = arg;
+
+	pthread_mutex_lock(&pacer->mutex);
+
+	while (pacer->running) {
+		// Wait for the render thread to begin the last frame we waited on.
+		// The runtime won't let xrWaitFrame return again before that anyway.
+
+		while (pacer->running && pacer->ready) {
+			pthread_cond_wait(&pacer->cond, &pacer->mutex);
+		}
+
+		if (!pacer->running) {
+			break;
+		}
+
+		// Wait for the next frame without holding the lock, so the render thread can keep going.
+
+		pthread_mutex_unlock(&pacer->mutex);
+
+		XrFrameState frame_state = {XR_TYPE_FRAME_STATE};
+		XrFrameWaitInfo const frame_wait_info = {XR_TYPE_FRAME_WAIT_INFO};
+		XrResult const res = xrWaitFrame(pacer->sesh, &frame_wait_info, &frame_state);
+
+		pthread_mutex_lock(&pacer->mutex);
+
+		if (res != XR_SUCCESS) {
+			LOGE("xrWaitFrame failed: %d.", res);
+			pacer->running = false;
+			break;
+		}
+
+		// Count the display times the runtime skipped over as missed frames.
+
+		XrDuration const period = frame_state.predictedDisplayPeriod;
+
+		if (pacer->last_display_time != 0 && period > 0) {
+			XrDuration const delta = frame_state.predictedDisplayTime - pacer->last_display_time;
+			int64_t const skipped = (delta + period / 2) / period - 1;
+
+			if (skipped > 0) {
+				pacer->missed += skipped;
+			}
+		}
+
+		pacer->last_display_time = frame_state.predictedDisplayTime;
+
+		pacer->frame_state = frame_state;
+		pacer->ready = true;
+
+		pthread_cond_broadcast(&pacer->cond);
+	}
+
+	pthread_cond_broadcast(&pacer->cond);
+	pthread_mutex_unlock(&pacer->mutex);
+
+	return NULL;
+}
+
+int frame_pacer_start(frame_pacer_t* pacer, XrSession sesh) {
+	frame_pacer_stop(pacer);
+
+	pacer->sesh = sesh;
+	pacer->running = true;
+	pacer->ready = false;
+	pacer->last_display_time = 0;
+
+	if (pthread_create(&pacer->thread, NULL, frame_pacer_thread, pacer) != 0) {
+		LOGE("Failed to create frame pacer thread.");
+		pacer->running = false;
+		pacer->sesh = XR_NULL_HANDLE;
+
+		return -1;
+	}
+
+	return 0;
+}
+
+void frame_pacer_stop(frame_pacer_t* pacer) {
+	if (pacer->sesh == XR_NULL_HANDLE) {
+		return;
+	}
+
+	pthread_mutex_lock(&pacer->mutex);
+	pacer->running = false;
+	pthread_cond_broadcast(&pacer->cond);
+	pthread_mutex_unlock(&pacer->mutex);
+
+	// If the thread is in xrWaitFrame, this waits for it to return.
+	// The runtime keeps pacing frames until the session ends, so that's not going to take long.
+
+	pthread_join(pacer->thread, NULL);
+
+	pacer->sesh = XR_NULL_HANDLE;
+	pacer->ready = false;
+}
+
+bool frame_pacer_next(frame_pacer_t* pacer, uint64_t timeout, XrFrameState* frame_state) {
+	uint64_t const deadline = clock_now() + timeout;
+
+	struct timespec const ts = {
+		.tv_sec = deadline / 1000000000,
+		.tv_nsec = deadline % 1000000000,
+	};
+
+	pthread_mutex_lock(&pacer->mutex);
+
+	while (pacer->running && !pacer->ready) {
+		if (pthread_cond_timedwait(&pacer->cond, &pacer->mutex, &ts) != 0) {
+			break;
+		}
+	}
+
+	bool const ready = pacer->ready;
+
+	if (ready) {
+		*frame_state = pacer->frame_state;
+	}
+
+	pthread_mutex_unlock(&pacer->mutex);
+	return ready;
+}
+
+XrResult frame_pacer_begin(frame_pacer_t* pacer) {
+	pacer->begin_time = clock_now();
+
+	XrFrameBeginInfo const frame_begin_info = {XR_TYPE_FRAME_BEGIN_INFO};
+	XrResult const res = xrBeginFrame(pacer->sesh, &frame_begin_info);
+
+	// Whatever happened, this frame is gone, so let the thread move on to the next one.
+
+	pthread_mutex_lock(&pacer->mutex);
+	pacer->ready = false;
+	pthread_cond_broadcast(&pacer->cond);
+	pthread_mutex_unlock(&pacer->mutex);
+
+	return res;
+}
+
+uint64_t frame_pacer_end(frame_pacer_t* pacer, uint64_t gpu_time) {
+	uint64_t const now = clock_now();
+	uint64_t const cpu_time = now - pacer->begin_time;
+
+	pacer->frames++;
+	pacer->cpu_time_total += cpu_time;
+	pacer->gpu_time = gpu_time;
+
+	if (cpu_time > pacer->cpu_time_max) {
+		pacer->cpu_time_max = cpu_time;
+	}
+
+	// Log statistics every so often.
+
+	if (now - pacer->last_stats_time < FRAME_PACER_STATS_INTERVAL) {
+		return cpu_time;
+	}
+
+	pthread_mutex_lock(&pacer->mutex);
+	size_t const missed = pacer->missed;
+	pacer->missed = 0;
+	pthread_mutex_unlock(&pacer->mutex);
+
+	LOGI(
+		"Frames: %zu, missed: %zu. CPU frame time: %.2f ms (max %.2f ms), GPU frame time: %.2f ms.",
+		pacer->frames,
+		missed,
+		pacer->cpu_time_total / 1e6 / pacer->frames,
+		pacer->cpu_time_max / 1e6,
+		pacer->gpu_time / 1e6
+	);
+
+	pacer->last_stats_time = now;
+	pacer->frames = 0;
+	pacer->cpu_time_total = 0;
+	pacer->cpu_time_max = 0;
+
+	return cpu_time;
+}
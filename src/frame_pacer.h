@@ -0,0 +1,80 @@
+#pragma once
+
+#include <jni.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+#define XR_USE_PLATFORM_ANDROID
+#define XR_USE_GRAPHICS_API_OPENGL_ES
+
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+// How often to log frame statistics, in nanoseconds.
+
+#define FRAME_PACER_STATS_INTERVAL 1000000000
+
+// Calls xrWaitFrame on its own thread, so that the render thread never blocks on it.
+// As soon as a frame is begun, the thread goes on to wait for the next one, so the CPU work for a frame can start as soon as the runtime lets it (while the GPU is still busy with the last one), and the render thread is free to poll events in the meantime.
+
+typedef struct {
+	XrSession sesh;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	// Whether the thread is running, and whether it's waited on a frame which hasn't been begun yet.
+
+	bool running;
+	bool ready;
+	XrFrameState frame_state;
+
+	// Statistics, gathered since the last time they were logged.
+	// A frame is counted as missed when the runtime skips over its display time.
+
+	XrTime last_display_time;
+	uint64_t begin_time;
+	uint64_t last_stats_time;
+
+	size_t frames;
+	size_t missed;
+	uint64_t cpu_time_total;
+	uint64_t cpu_time_max;
+	uint64_t gpu_time;
+} frame_pacer_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+void frame_pacer_create(frame_pacer_t* pacer);
+void frame_pacer_destroy(frame_pacer_t* pacer);
+
+// Start waiting on frames for a session which has just begun, and stop doing so before it ends.
+
+int frame_pacer_start(frame_pacer_t* pacer, XrSession sesh);
+void frame_pacer_stop(frame_pacer_t* pacer);
+
+// Wait at most 'timeout' nanoseconds for the next frame.
+// Returns whether there is one, in which case its state is copied to 'frame_state' and it must be begun with frame_pacer_begin.
+
+bool frame_pacer_next(frame_pacer_t* pacer, uint64_t timeout, XrFrameState* frame_state);
+
+// Begin the frame we got from frame_pacer_next and let the thread wait on the next one.
+
+XrResult frame_pacer_begin(frame_pacer_t* pacer);
+
+// Call once xrEndFrame has returned, with the last GPU time we know of (in nanoseconds).
+// Returns the CPU time of the frame.
+
+uint64_t frame_pacer_end(frame_pacer_t* pacer, uint64_t gpu_time);
+
+#if defined(__cplusplus)
+}
+#endif
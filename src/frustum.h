@@ -0,0 +1,54 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <stdbool.h>
+
+#include <openxr/openxr.h>
+
+// A view frustum as 4 world-space planes (left, right, up, down).
+// Each plane is stored as a normal pointing out of the frustum and a distance, so that a point p is outside of it when dot(normal, p) + distance > 0.
+// There are no near and far planes: windows are never close enough or far enough for these to matter, and as long as the FOV is less than 180 degrees on each axis, anything behind the view is already outside of the side planes.
+
+typedef struct {
+	float planes[4][4];
+} frustum_t;
+
+static inline void frustum_from_view(frustum_t* frustum, matrix_t view_matrix, XrFovf fov) {
+	// Planes in view space (looking down -Z).
+	// They all go through the origin, so they have no distance.
+
+	float const view_planes[4][3] = {
+		{-cosf(fov.angleLeft), 0, -sinf(fov.angleLeft)},
+		{cosf(fov.angleRight), 0, sinf(fov.angleRight)},
+		{0, cosf(fov.angleUp), sinf(fov.angleUp)},
+		{0, -cosf(fov.angleDown), -sinf(fov.angleDown)},
+	};
+
+	// Bring them back into world space.
+	// The view matrix takes world-space points p to R * p + t, so dot(n, R * p + t) = dot(R^T * n, p) + dot(n, t).
+
+	for (int i = 0; i < 4; i++) {
+		float const* const n = view_planes[i];
+		float* const plane = frustum->planes[i];
+
+		for (int j = 0; j < 3; j++) {
+			plane[j] = view_matrix[j][0] * n[0] + view_matrix[j][1] * n[1] + view_matrix[j][2] * n[2];
+		}
+
+		plane[3] = view_matrix[3][0] * n[0] + view_matrix[3][1] * n[1] + view_matrix[3][2] * n[2];
+	}
+}
+
+static inline bool frustum_sphere_visible(frustum_t const* frustum, float const centre[3], float radius) {
+	for (int i = 0; i < 4; i++) {
+		float const* const plane = frustum->planes[i];
+		float const dist = plane[0] * centre[0] + plane[1] * centre[1] + plane[2] * centre[2] + plane[3];
+
+		if (dist > radius) {
+			return false;
+		}
+	}
+
+	return true;
+}
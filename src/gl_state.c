@@ -0,0 +1,146 @@
+#include "gl_state.h"
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+#include <assert.h>
+#include <stdbool.h>
+
+// Value we never expect a GL object name to take, for state we don't know.
+
+#define UNKNOWN ((GLuint) -1)
+
+#define UBO_BINDINGS 4
+
+static struct {
+	GLuint program;
+	GLuint fbo;
+	GLuint vao;
+	GLuint active_unit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS];
+	GLuint cube_textures[GL_STATE_TEXTURE_UNITS];
+	struct {
+		GLuint ubo;
+		GLintptr offset;
+		GLsizeiptr size;
+	} ubos[UBO_BINDINGS];
+	GLint viewport[4];
+	bool viewport_known;
+} state;
+
+static gl_state_stats_t stats;
+
+void gl_state_reset(void) {
+	state.program = UNKNOWN;
+	state.fbo = UNKNOWN;
+	state.vao = UNKNOWN;
+	state.active_unit = UNKNOWN;
+
+	for (size_t i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+		state.textures[i] = UNKNOWN;
+		state.cube_textures[i] = UNKNOWN;
+	}
+
+	for (size_t i = 0; i < UBO_BINDINGS; i++) {
+		state.ubos[i].ubo = UNKNOWN;
+	}
+
+	state.viewport_known = false;
+}
+
+gl_state_stats_t gl_state_take_stats(void) {
+	gl_state_stats_t const rv = stats;
+	stats = (gl_state_stats_t) {0};
+	return rv;
+}
+
+// Record whether a call is needed to get a piece of state to a new value, and update the cached value if so.
+
+static bool changed(GLuint* cached, GLuint val) {
+	if (*cached == val) {
+		stats.elided++;
+		return false;
+	}
+
+	stats.issued++;
+	*cached = val;
+
+	return true;
+}
+
+void gl_state_use_program(GLuint program) {
+	if (changed(&state.program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void gl_state_bind_framebuffer(GLuint fbo) {
+	if (changed(&state.fbo, fbo)) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	}
+}
+
+void gl_state_bind_vertex_array(GLuint vao) {
+	if (changed(&state.vao, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+// Each texture unit has a separate binding for each target.
+// The unit is made active even if the texture is already bound to it, as the caller might be binding it to edit it.
+
+static void bind_texture(GLuint* bound, GLenum target, GLuint unit, GLuint tex) {
+	assert(unit < GL_STATE_TEXTURE_UNITS);
+
+	if (changed(&state.active_unit, unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	if (changed(&bound[unit], tex)) {
+		glBindTexture(target, tex);
+	}
+}
+
+void gl_state_bind_texture(GLuint unit, GLuint tex) {
+	bind_texture(state.textures, GL_TEXTURE_2D, unit, tex);
+}
+
+void gl_state_bind_texture_cube(GLuint unit, GLuint tex) {
+	bind_texture(state.cube_textures, GL_TEXTURE_CUBE_MAP, unit, tex);
+}
+
+void gl_state_bind_uniform_buffer(GLuint index, GLuint ubo, GLintptr offset, GLsizeiptr size) {
+	assert(index < UBO_BINDINGS);
+
+	if (state.ubos[index].ubo == ubo && state.ubos[index].offset == offset && state.ubos[index].size == size) {
+		stats.elided++;
+		return;
+	}
+
+	stats.issued++;
+
+	state.ubos[index].ubo = ubo;
+	state.ubos[index].offset = offset;
+	state.ubos[index].size = size;
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, index, ubo, offset, size);
+}
+
+void gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	GLint* const viewport = state.viewport;
+
+	if (state.viewport_known && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+		stats.elided++;
+		return;
+	}
+
+	stats.issued++;
+
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+
+	state.viewport_known = true;
+	glViewport(x, y, width, height);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/gles2.h>
+
+#include <stddef.h>
+
+// Number of texture units we track bindings for.
+
+#define GL_STATE_TEXTURE_UNITS 8
+
+// Thin cache over the bits of GL state we change often, which skips calls that wouldn't change anything.
+// All changes to this state have to go through here, or the cache will be out of sync with the actual GL state.
+// If something does change it behind our back (or deletes an object which might be bound), call gl_state_reset.
+// There's only ever the one GL context, so this is global.
+
+typedef struct {
+	size_t issued;
+	size_t elided;
+} gl_state_stats_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Forget all cached state, so the next call of each kind is always issued.
+
+void gl_state_reset(void);
+
+// Get the number of calls issued and elided since the last call to this.
+
+gl_state_stats_t gl_state_take_stats(void);
+
+void gl_state_use_program(GLuint program);
+void gl_state_bind_framebuffer(GLuint fbo);
+void gl_state_bind_vertex_array(GLuint vao);
+
+// Binding a texture always leaves its unit active, so calls which act on the bound texture (glTexImage2D, glTexParameteri, &c) can follow it.
+
+void gl_state_bind_texture(GLuint unit, GLuint tex); // GL_TEXTURE_2D.
+void gl_state_bind_texture_cube(GLuint unit, GLuint tex); // GL_TEXTURE_CUBE_MAP.
+void gl_state_bind_uniform_buffer(GLuint index, GLuint ubo, GLintptr offset, GLsizeiptr size);
+void gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+#if defined(__cplusplus)
+}
+#endif
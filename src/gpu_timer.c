@@ -0,0 +1,80 @@
+#include "gpu_timer.h"
+#include "log.h"
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+void gpu_timer_create(gpu_timer_t* timer) {
+	timer->supported = GLAD_GL_EXT_disjoint_timer_query;
+	timer->running = false;
+	timer->head = 0;
+	timer->pending = 0;
+
+	if (!timer->supported) {
+		LOGW("GL_EXT_disjoint_timer_query not supported, can't time GPU work.");
+		return;
+	}
+
+	glGenQueriesEXT(GPU_TIMER_QUERY_COUNT, timer->queries);
+}
+
+void gpu_timer_destroy(gpu_timer_t* timer) {
+	if (timer->supported) {
+		glDeleteQueriesEXT(GPU_TIMER_QUERY_COUNT, timer->queries);
+	}
+}
+
+void gpu_timer_begin(gpu_timer_t* timer) {
+	if (!timer->supported || timer->pending == GPU_TIMER_QUERY_COUNT) {
+		return;
+	}
+
+	glBeginQueryEXT(GL_TIME_ELAPSED_EXT, timer->queries[timer->head]);
+	timer->running = true;
+}
+
+void gpu_timer_end(gpu_timer_t* timer) {
+	if (!timer->running) {
+		return;
+	}
+
+	glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+
+	timer->running = false;
+	timer->head = (timer->head + 1) % GPU_TIMER_QUERY_COUNT;
+	timer->pending++;
+}
+
+bool gpu_timer_poll(gpu_timer_t* timer, uint64_t* ns) {
+	if (timer->pending == 0) {
+		return false;
+	}
+
+	size_t const tail = (timer->head + GPU_TIMER_QUERY_COUNT - timer->pending) % GPU_TIMER_QUERY_COUNT;
+	GLuint const query = timer->queries[tail];
+
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuivEXT(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+
+	if (!available) {
+		return false;
+	}
+
+	timer->pending--;
+
+	// If anything happened which makes timings unreliable, we have to throw away this result.
+	// Checking this also resets the flag.
+
+	GLint disjoint = GL_FALSE;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	if (disjoint) {
+		return false;
+	}
+
+	GLuint64 result = 0;
+	glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_EXT, &result);
+	*ns = result;
+
+	return true;
+}
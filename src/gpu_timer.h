@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glad/gles2.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of timer queries in flight.
+// Results typically come back a couple of frames late, so this needs to be a bit more than that.
+
+#define GPU_TIMER_QUERY_COUNT 4
+
+// Measures how long some GPU work took with GL_EXT_disjoint_timer_query.
+// Queries are kept in a ring so that we never stall waiting on a result.
+
+typedef struct {
+	bool supported;
+	bool running;
+
+	size_t head; // Next query to begin.
+	size_t pending; // Number of queries waiting on a result.
+	GLuint queries[GPU_TIMER_QUERY_COUNT];
+} gpu_timer_t;
+
+void gpu_timer_create(gpu_timer_t* timer);
+void gpu_timer_destroy(gpu_timer_t* timer);
+
+// Start and stop timing.
+// These do nothing if all the queries are still in flight.
+
+void gpu_timer_begin(gpu_timer_t* timer);
+void gpu_timer_end(gpu_timer_t* timer);
+
+// Get the oldest result which is ready, in nanoseconds.
+// Returns false if none are or if the timing was disjoint (e.g. the GPU changed frequency).
+
+bool gpu_timer_poll(gpu_timer_t* timer, uint64_t* ns);
@@ -0,0 +1,187 @@
+#include "ktx2.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Vulkan formats we know the GL equivalent of.
+// The ASTC ones alternate between UNORM and SRGB for each block size, in the same order as GL's.
+
+#define VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK 147
+#define VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK 152
+#define VK_FORMAT_ASTC_4x4_UNORM_BLOCK 157
+#define VK_FORMAT_ASTC_12x12_SRGB_BLOCK 184
+
+static uint8_t const IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Header, followed by the index and then the level index.
+// Everything is little-endian, like us.
+
+typedef struct {
+	uint8_t identifier[12];
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t pixel_width;
+	uint32_t pixel_height;
+	uint32_t pixel_depth;
+	uint32_t layer_count;
+	uint32_t face_count;
+	uint32_t level_count;
+	uint32_t supercompression_scheme;
+
+	uint32_t dfd_byte_offset;
+	uint32_t dfd_byte_length;
+	uint32_t kvd_byte_offset;
+	uint32_t kvd_byte_length;
+	uint64_t sgd_byte_offset;
+	uint64_t sgd_byte_length;
+} header_t;
+
+typedef struct {
+	uint64_t byte_offset;
+	uint64_t byte_length;
+	uint64_t uncompressed_byte_length;
+} level_index_t;
+
+static GLenum vk_format_to_gl(uint32_t vk_format) {
+	if (vk_format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && vk_format <= VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK) {
+		GLenum const formats[] = {
+			GL_COMPRESSED_RGB8_ETC2,
+			GL_COMPRESSED_SRGB8_ETC2,
+			GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+			GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+			GL_COMPRESSED_RGBA8_ETC2_EAC,
+			GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC,
+		};
+
+		return formats[vk_format - VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK];
+	}
+
+	if (vk_format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && vk_format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+		uint32_t const i = vk_format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+		return (i % 2 ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 : GL_COMPRESSED_RGBA_ASTC_4x4) + i / 2;
+	}
+
+	return GL_NONE;
+}
+
+int ktx2_parse(ktx2_t* ktx, void const* buf, size_t size) {
+	header_t header;
+
+	if (size < sizeof header) {
+		LOGE("KTX2 texture is too small to have a header.");
+		return -1;
+	}
+
+	memcpy(&header, buf, sizeof header);
+
+	if (memcmp(header.identifier, IDENTIFIER, sizeof IDENTIFIER) != 0) {
+		LOGE("Not a KTX2 texture.");
+		return -1;
+	}
+
+	ktx->format = vk_format_to_gl(header.vk_format);
+
+	if (ktx->format == GL_NONE) {
+		LOGE("KTX2 texture has unsupported format %u (only ETC2 and ASTC are supported).", header.vk_format);
+		return -1;
+	}
+
+	if (header.supercompression_scheme != 0) {
+		LOGE("KTX2 texture is supercompressed (scheme %u), which isn't supported.", header.supercompression_scheme);
+		return -1;
+	}
+
+	if (header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+		LOGE("KTX2 texture isn't a single 2D image.");
+		return -1;
+	}
+
+	// A level count of 0 means the loader is supposed to generate mips itself, which we can't do for compressed formats.
+	// There's still the one level though.
+
+	ktx->x_res = header.pixel_width;
+	ktx->y_res = header.pixel_height;
+	ktx->level_count = header.level_count == 0 ? 1 : header.level_count;
+
+	if (ktx->x_res == 0 || ktx->y_res == 0) {
+		LOGE("KTX2 texture has no pixels.");
+		return -1;
+	}
+
+	if (ktx->level_count > KTX2_MAX_LEVELS) {
+		LOGE("KTX2 texture has too many levels (%u).", ktx->level_count);
+		return -1;
+	}
+
+	if (size < sizeof header + ktx->level_count * sizeof(level_index_t)) {
+		LOGE("KTX2 texture is too small for its level index.");
+		return -1;
+	}
+
+	uint8_t const* const bytes = buf;
+
+	for (size_t i = 0; i < ktx->level_count; i++) {
+		level_index_t level;
+		memcpy(&level, bytes + sizeof header + i * sizeof level, sizeof level);
+
+		if (level.byte_offset > size || level.byte_length > size - level.byte_offset) {
+			LOGE("KTX2 texture level %zu is out of bounds.", i);
+			return -1;
+		}
+
+		ktx->levels[i] = (ktx2_level_t) {
+			.data = bytes + level.byte_offset,
+			.size = level.byte_length,
+		};
+	}
+
+	return 0;
+}
+
+bool ktx2_format_supported(GLenum format) {
+	// ETC2 is core in GLES 3, ASTC isn't.
+
+	if (format >= GL_COMPRESSED_RGB8_ETC2 && format <= GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC) {
+		return true;
+	}
+
+	return GLAD_GL_KHR_texture_compression_astc_ldr;
+}
+
+static void level_res(ktx2_t const* ktx, size_t level, GLsizei* x_res, GLsizei* y_res) {
+	*x_res = ktx->x_res >> level;
+	*y_res = ktx->y_res >> level;
+
+	*x_res = *x_res < 1 ? 1 : *x_res;
+	*y_res = *y_res < 1 ? 1 : *y_res;
+}
+
+void ktx2_tex_image(ktx2_t const* ktx, GLenum target) {
+	for (size_t i = 0; i < ktx->level_count; i++) {
+		GLsizei x_res, y_res;
+		level_res(ktx, i, &x_res, &y_res);
+		glCompressedTexImage2D(target, i, ktx->format, x_res, y_res, 0, ktx->levels[i].size, ktx->levels[i].data);
+	}
+}
+
+void ktx2_tex_sub_image(ktx2_t const* ktx, GLenum target) {
+	for (size_t i = 0; i < ktx->level_count; i++) {
+		GLsizei x_res, y_res;
+		level_res(ktx, i, &x_res, &y_res);
+		glCompressedTexSubImage2D(target, i, 0, 0, x_res, y_res, ktx->format, ktx->levels[i].size, ktx->levels[i].data);
+	}
+}
+
+void ktx2_skip_levels(ktx2_t* ktx, uint32_t count) {
+	assert(count < ktx->level_count);
+
+	GLsizei x_res, y_res;
+	level_res(ktx, count, &x_res, &y_res);
+
+	ktx->x_res = x_res;
+	ktx->y_res = y_res;
+	ktx->level_count -= count;
+
+	memmove(ktx->levels, ktx->levels + count, ktx->level_count * sizeof *ktx->levels);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/gles2.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of mip levels a texture can have (enough for 32768x32768).
+
+#define KTX2_MAX_LEVELS 16
+
+// Minimal reader for KTX2 textures (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html).
+// Only what we need for environments is supported: a single 2D image in an ETC2 or ASTC (LDR) format, without supercompression, so that its levels can be handed to glCompressedTexImage2D as they are.
+// Nothing is copied; levels point into the buffer the texture was parsed from, which must outlive it.
+
+typedef struct {
+	void const* data;
+	size_t size;
+} ktx2_level_t;
+
+typedef struct {
+	GLenum format;
+
+	uint32_t x_res;
+	uint32_t y_res;
+
+	// Levels go from the full-resolution image (0) to the smallest mip.
+
+	uint32_t level_count;
+	ktx2_level_t levels[KTX2_MAX_LEVELS];
+} ktx2_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Returns -1 if the buffer isn't a KTX2 texture we can use.
+
+int ktx2_parse(ktx2_t* ktx, void const* buf, size_t size);
+
+// Whether the GL implementation can sample a texture in this (compressed) format.
+
+bool ktx2_format_supported(GLenum format);
+
+// Upload all levels to the texture bound to 'target', either allocating its storage (glCompressedTexImage2D) or into storage it already has (glCompressedTexSubImage2D, e.g. for swapchain images).
+
+void ktx2_tex_image(ktx2_t const* ktx, GLenum target);
+void ktx2_tex_sub_image(ktx2_t const* ktx, GLenum target);
+
+// Drop the first 'count' levels, so that the texture starts at a smaller mip (e.g. for a low-resolution preview).
+// 'count' must be less than the texture's level count.
+
+void ktx2_skip_levels(ktx2_t* ktx, uint32_t count);
+
+#if defined(__cplusplus)
+}
+#endif
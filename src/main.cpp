@@ -2,6 +2,12 @@
 #include "log.h"
 #include "env.h"
 #include "desktop.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "alloc_debug.h"
+#include "arena.h"
+#include "clock.h"
+#include "frame_pacer.h"
 
 #include <cassert>
 #include <jni.h>
@@ -13,6 +19,7 @@
 #include <glad/gles2.h>
 
 #include <android_native_app_glue.h>
+#include <sys/system_properties.h>
 
 #define XR_USE_PLATFORM_ANDROID
 #define XR_USE_GRAPHICS_API_OPENGL_ES
@@ -20,6 +27,23 @@
 #include <openxr/openxr.h>
 #include <openxr/openxr_platform.h>
 
+// Size of the arena for transient per-frame data.
+// This is way more than we need, but it's allocated once so it doesn't matter.
+
+#define FRAME_ARENA_SIZE (64 * 1024)
+
+// How long to wait for the next frame before going back to polling events, in nanoseconds.
+// Frames are rendered as soon as they're ready regardless; this only bounds how late events can be handled.
+
+#define EVENT_POLL_INTERVAL (2 * 1000 * 1000)
+
+// Environment shown at startup, unless set otherwise with e.g. 'adb shell setprop debug.mist.env galaxy'.
+// Changing that property while we're running switches to the new environment, which is checked for this often (in nanoseconds) and faded in over ENV_FADE_DURATION (in XrTime units, i.e. nanoseconds).
+
+#define DEFAULT_ENV "serenity"
+#define ENV_POLL_INTERVAL 1000000000
+#define ENV_FADE_DURATION 1000000000
+
 typedef struct {
 	struct android_app* app;
 	bool resumed;
@@ -32,10 +56,168 @@ typedef struct {
 	XrEnvironmentBlendMode env_blend_mode;
 	XrSpace local_space;
 
+	// At startup, a low-resolution preview of the environment is shown first, and the full one is then switched to like any other environment.
+
+	mist_env_load_t preview_load;
+	mist_env_load_t env_load;
 	mist_env_t env;
 	desktop_t desktop;
+
+	// Switching environments (see env_switch).
+	// The next one is loaded on a worker thread and created a step per frame, after which it's faded in over the current one if XR_KHR_composition_layer_color_scale_bias lets us.
+	// Once it's fully in, it takes the place of the current one, which the desktop keeps pointing to.
+
+	char env_name[PROP_VALUE_MAX];
+	bool env_cubemap;
+	uint64_t last_env_poll;
+	bool color_scale_bias;
+
+	bool env_switching;
+	bool next_env_created;
+	mist_env_t next_env;
+	XrTime fade_start;
+	XrCompositionLayerColorScaleBiasKHR fade;
+
+	arena_t frame_arena;
+	frame_pacer_t frame_pacer;
+
+	bool first_frame_submitted;
 } state_t;
 
+// When android_main was entered, on the monotonic clock.
+// Startup is logged as a timeline relative to this, with events from worker threads logged along with when they happened so they line up with what the main thread was doing at the time.
+
+static uint64_t startup_time = 0;
+
+static void startup_event(char const* thread, char const* event, uint64_t time = clock_now()) {
+	LOGI("Startup timeline: %8.2f ms [%s] %s.", (time - startup_time) / 1e6, thread, event);
+}
+
+// Read a boolean developer option from the Android system properties.
+// These can be set with e.g. 'adb shell setprop debug.mist.win_layers 1'.
+
+static bool debug_prop(char const* name, bool fallback) {
+	char val[PROP_VALUE_MAX] = "";
+
+	if (__system_property_get(name, val) <= 0) {
+		return fallback;
+	}
+
+	return strcmp(val, "1") == 0 || strcmp(val, "true") == 0;
+}
+
+// Read the name of the environment we should be showing into 'name' (which must be PROP_VALUE_MAX bytes).
+
+static void env_prop(char* name) {
+	if (__system_property_get("debug.mist.env", name) <= 0) {
+		strcpy(name, DEFAULT_ENV);
+	}
+}
+
+// Start switching environments if the one we should be showing changed.
+// Only one switch happens at a time; if it changes again in the meantime, we'll switch again once we're done.
+
+static void env_poll(state_t* s) {
+	uint64_t const now = clock_now();
+
+	if (s->env_switching || now - s->last_env_poll < ENV_POLL_INTERVAL) {
+		return;
+	}
+
+	s->last_env_poll = now;
+
+	char name[PROP_VALUE_MAX];
+	env_prop(name);
+
+	if (strcmp(name, s->env_name) == 0) {
+		return;
+	}
+
+	// Whether or not the switch works out, we don't want to keep on retrying it.
+
+	strcpy(s->env_name, name);
+	LOGI("Switching to environment %s.", name);
+
+	mist_env_opts_t const opts = {
+		.preview = false,
+		.cubemap = s->env_cubemap,
+	};
+
+	if (mist_env_load(&s->env_load, s->app->activity->assetManager, name, &opts) < 0) {
+		return;
+	}
+
+	s->env_switching = true;
+	s->next_env_created = false;
+	s->fade_start = 0;
+}
+
+// Make progress on switching environments, and add the layers for the environment(s) to show this frame to 'layers'.
+// Creating the next environment is done a step per frame once it's loaded, so that it never holds a frame up.
+
+static void env_switch(state_t* s, XrTime display_time, XrCompositionLayerBaseHeader const** layers, size_t* layer_count) {
+	layers[(*layer_count)++] = reinterpret_cast<XrCompositionLayerBaseHeader const*>(&s->env.layer);
+
+	if (!s->env_switching) {
+		return;
+	}
+
+	if (!s->next_env_created) {
+		if (!mist_env_loaded(&s->env_load)) {
+			return;
+		}
+
+		int const rv = mist_env_create_step(&s->next_env, s->session, s->local_space, &s->env_load);
+
+		if (rv < 0) {
+			LOGE("Failed to create environment %s, not switching to it.", s->env_load.name);
+			s->env_switching = false;
+		}
+
+		s->next_env_created = rv == 1;
+		return;
+	}
+
+	// Fade the next environment in over the current one.
+	// Layers are premultiplied, so scaling all channels fades them out uniformly.
+
+	float fade = 1;
+
+	if (s->color_scale_bias) {
+		if (s->fade_start == 0) {
+			s->fade_start = display_time;
+		}
+
+		fade = (float) (display_time - s->fade_start) / ENV_FADE_DURATION;
+	}
+
+	if (fade < 1) {
+		s->fade = {
+			.type = XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR,
+			.next = nullptr,
+			.colorScale = {fade, fade, fade, fade},
+			.colorBias = {0, 0, 0, 0},
+		};
+
+		s->next_env.layer.next = &s->fade;
+		layers[(*layer_count)++] = reinterpret_cast<XrCompositionLayerBaseHeader const*>(&s->next_env.layer);
+
+		return;
+	}
+
+	// It's fully in, so it can replace the current one.
+	// The compositor might still be using the current one's swapchain for the last frame we submitted, but destroying it is deferred until it's done with it.
+
+	mist_env_destroy(&s->env);
+
+	s->env = s->next_env;
+	s->env.layer.next = nullptr;
+	s->env_switching = false;
+
+	layers[*layer_count - 1] = reinterpret_cast<XrCompositionLayerBaseHeader const*>(&s->env.layer);
+	LOGI("Switched to environment %s.", s->env_name);
+}
+
 static XrBool32 debug_utils_messenger_cb(
 	XrDebugUtilsMessageSeverityFlagsEXT severity,
 	XrDebugUtilsMessageTypeFlagsEXT type,
@@ -133,36 +315,53 @@ static void gl_debug_cb(GLenum source, GLenum type, GLuint id, GLenum severity,
 	__android_log_print(sev, "mist-log", "    Severity: %s", severity_str);
 }
 
-static void render(state_t* s) {
-	// Wait for a frame.
+// Render a frame the frame pacer has waited on for us.
 
-	XrFrameState frame_state = {XR_TYPE_FRAME_STATE};
-	XrFrameWaitInfo frame_wait_info = {XR_TYPE_FRAME_WAIT_INFO};
-	assert(xrWaitFrame(s->session, &frame_wait_info, &frame_state) == XR_SUCCESS);
+static void render(state_t* s, XrFrameState const& frame_state) {
+	// Begin the frame.
+	// This lets the frame pacer start waiting on the next one.
 
-	// Begin a frame.
-
-	XrFrameBeginInfo frame_begin_info = {XR_TYPE_FRAME_BEGIN_INFO};
-	assert(xrBeginFrame(s->session, &frame_begin_info) == XR_SUCCESS);
+	if (XR_FAILED(frame_pacer_begin(&s->frame_pacer))) {
+		LOGE("Failed to begin frame.");
+		return;
+	}
 
 	// Render layers.
+	// Everything transient for this frame comes from the frame arena, which we can reset now that the last frame has been submitted.
+
+	arena_reset(&s->frame_arena);
 
-	auto layers = std::vector<XrCompositionLayerBaseHeader*>();
+	size_t layer_count = 0;
+	XrCompositionLayerBaseHeader const** layers = nullptr;
 
 	bool const active = s->session_state == XR_SESSION_STATE_SYNCHRONIZED || s->session_state == XR_SESSION_STATE_VISIBLE || s->session_state == XR_SESSION_STATE_FOCUSED;
 
-	XrCompositionLayerEquirect2KHR layer_env;
-	XrCompositionLayerProjection layer_desktop;
+	if (active && frame_state.shouldRender) {
+		// There can be two environment layers while we're fading between them.
 
-	XrCompositionLayerProjectionView* layer_views = NULL;
+		XrCompositionLayerBaseHeader const* env_layers[2];
+		size_t env_layer_count = 0;
 
-	if (active && frame_state.shouldRender) {
-		if (mist_env_render(&s->env, s->local_space, &layer_env) == 0) {
-			layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&layer_env));
+		env_switch(s, frame_state.predictedDisplayTime, env_layers, &env_layer_count);
+
+		size_t desktop_layer_count = 0;
+		XrCompositionLayerBaseHeader const* const* desktop_layers = nullptr;
+
+		if (desktop_render(&s->desktop, &s->frame_arena, s->local_space, s->view_config, frame_state.predictedDisplayTime, frame_state.predictedDisplayPeriod, &desktop_layer_count, &desktop_layers) < 0) {
+			desktop_layer_count = 0;
 		}
 
-		if (desktop_render(&s->desktop, s->local_space, s->view_config, frame_state.predictedDisplayTime, &layer_desktop, &layer_views) == 0) {
-			layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&layer_desktop));
+		// The environment goes underneath the desktop.
+
+		layers = static_cast<XrCompositionLayerBaseHeader const**>(arena_alloc(&s->frame_arena, env_layer_count + desktop_layer_count, sizeof *layers));
+		assert(layers != nullptr);
+
+		for (size_t i = 0; i < env_layer_count; i++) {
+			layers[layer_count++] = env_layers[i];
+		}
+
+		for (size_t i = 0; i < desktop_layer_count; i++) {
+			layers[layer_count++] = desktop_layers[i];
 		}
 	}
 
@@ -172,8 +371,8 @@ static void render(state_t* s) {
 		.type = XR_TYPE_FRAME_END_INFO,
 		.displayTime = frame_state.predictedDisplayTime,
 		.environmentBlendMode = s->env_blend_mode,
-		.layerCount = static_cast<uint32_t>(layers.size()),
-		.layers = layers.data(),
+		.layerCount = static_cast<uint32_t>(layer_count),
+		.layers = layers,
 	};
 
 	XrResult const res = xrEndFrame(s->session, &frame_end_info);
@@ -182,9 +381,15 @@ static void render(state_t* s) {
 		LOGE("Failed to render frame: %d", res);
 	}
 
-	// Clean up.
+	else if (layer_count > 0 && !s->first_frame_submitted) {
+		startup_event("main", "Submitted first frame");
+		s->first_frame_submitted = true;
+	}
 
-	free(layer_views);
+	uint64_t const cpu_time = frame_pacer_end(&s->frame_pacer, s->desktop.stats.gpu_time);
+	desktop_frame_ended(&s->desktop, cpu_time);
+
+	alloc_debug_frame();
 }
 
 static void android_handle_cmd(struct android_app* app, int32_t cmd) {
@@ -207,11 +412,42 @@ static void android_handle_cmd(struct android_app* app, int32_t cmd) {
 }
 
 void android_main(struct android_app* app) {
+	startup_time = clock_now();
+	startup_event("main", "Entered android_main");
+
 	state_t s = {};
 
 	app->onAppCmd = android_handle_cmd;
 	app->userData = &s;
 
+	// Start loading the environment straight away.
+	// Its assets are read and decoded on worker threads while we set up everything else, and it's only created from them (which needs GL) once we get to it.
+	// The preview is what we wait for before the first frame, so that doesn't depend on how large the full environment is.
+
+	s.app = app;
+	env_prop(s.env_name);
+	s.last_env_poll = clock_now();
+
+	// Whether to refract a cubemap rather than an equirectangular map can only be set at startup, as the desktop's shaders depend on it.
+
+	s.env_cubemap = debug_prop("debug.mist.env_cubemap", false);
+
+	mist_env_opts_t const preview_opts = {
+		.preview = true,
+		.cubemap = s.env_cubemap,
+	};
+
+	mist_env_opts_t const env_opts = {
+		.preview = false,
+		.cubemap = s.env_cubemap,
+	};
+
+	bool const preview = mist_env_load(&s.preview_load, app->activity->assetManager, s.env_name, &preview_opts) == 0;
+
+	if (mist_env_load(&s.env_load, app->activity->assetManager, s.env_name, &env_opts) < 0) {
+		return;
+	}
+
 	start_gvd(app->activity->assetManager);
 
 	// Initialize OpenXR loader.
@@ -323,6 +559,28 @@ void android_main(struct android_app* app) {
 		}
 	}
 
+	// Enable optional extensions alongside the required ones if the runtime has them.
+
+	bool cylinder_layers = false;
+	bool depth_layers = false;
+
+	for (auto& ext : exts) {
+		if (strcmp(ext.extensionName, XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME) == 0) {
+			required_exts.push_back(XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME);
+			cylinder_layers = true;
+		}
+
+		if (strcmp(ext.extensionName, XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME) == 0) {
+			required_exts.push_back(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME);
+			depth_layers = true;
+		}
+
+		if (strcmp(ext.extensionName, XR_KHR_COMPOSITION_LAYER_COLOR_SCALE_BIAS_EXTENSION_NAME) == 0) {
+			required_exts.push_back(XR_KHR_COMPOSITION_LAYER_COLOR_SCALE_BIAS_EXTENSION_NAME);
+			s.color_scale_bias = true;
+		}
+	}
+
 	// Actually create instance.
 
 	XrApplicationInfo const app_info = {
@@ -350,6 +608,8 @@ void android_main(struct android_app* app) {
 		return;
 	}
 
+	startup_event("main", "Created OpenXR instance");
+
 	// Get the instance properties.
 
 	XrInstanceProperties instance_props = {XR_TYPE_INSTANCE_PROPERTIES};
@@ -554,6 +814,8 @@ void android_main(struct android_app* app) {
 		return;
 	}
 
+	gl_state_reset();
+
 	LOGI("Glad loaded OpenGL ES version %d.%d.", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
 
 	LOGI("OpenGL ES vendor: %s.", glGetString(GL_VENDOR));
@@ -561,6 +823,11 @@ void android_main(struct android_app* app) {
 	LOGI("OpenGL ES renderer: %s.", glGetString(GL_RENDERER));
 	LOGI("OpenGL ES shading language version: %s.", glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+	// Set up shader creation, caching shaders in our files directory so we don't have to compile them all again every launch.
+
+	shader_init(app->activity->internalDataPath);
+	startup_event("main", "Set up OpenGL ES");
+
 	// Set up OpenGL debugging.
 
 	glEnable(GL_DEBUG_OUTPUT);
@@ -589,6 +856,8 @@ void android_main(struct android_app* app) {
 		return;
 	}
 
+	startup_event("main", "Created OpenXR session");
+
 	// Get view configurations.
 
 	uint32_t view_config_count = 0;
@@ -709,18 +978,58 @@ void android_main(struct android_app* app) {
 		return;
 	}
 
-	// Create Mist environment.
+	// Create Mist desktop.
+	// Windows can be submitted as their own composition layers, in which case the compositor samples them directly instead of us resampling them into the projection layer every frame.
+	// The runtime limits how many layers we can submit though, and besides windows we submit the projection layer and up to two environment layers (while fading between them).
+	// This is done before creating the environment, so that the desktop's shaders compile in the background while the environment is being decoded.
+
+	uint32_t const max_layers = sys_props.graphicsProperties.maxLayerCount;
+	LOGI("Runtime supports up to %u composition layers.", max_layers);
+
+	desktop_opts_t const desktop_opts = {
+		.win_layers = debug_prop("debug.mist.win_layers", false),
+		.max_win_layers = max_layers > 3 ? max_layers - 3 : 0,
+		.cylinder_layers = cylinder_layers,
+		.refraction = debug_prop("debug.mist.refraction", true),
+		.env_cubemap = s.env_cubemap,
+		.depth = depth_layers && debug_prop("debug.mist.depth", true),
+	};
 
-	if (mist_env_create(&s.env, s.session, app->activity->assetManager, "serenity") < 0) {
+	if (desktop_create(&s.desktop, s.session, s.view_config_views.size(), s.view_config_views.data(), &s.env, &desktop_opts) < 0) {
 		return;
 	}
 
-	// Create Mist desktop.
+	startup_event("main", "Created desktop");
+
+	// Create Mist environment from what was loaded in the background.
+	// If we have a preview, the full environment is streamed in over it over the next frames (see env_switch).
+	// Otherwise, we have no choice but to wait for the full one.
+
+	if (preview && mist_env_create(&s.env, s.session, s.local_space, &s.preview_load) == 0) {
+		s.env_switching = true;
+	}
 
-	if (desktop_create(&s.desktop, s.session, s.view_config_views.size(), s.view_config_views.data(), &s.env) < 0) {
+	else if (mist_env_create(&s.env, s.session, s.local_space, &s.env_load) < 0) {
 		return;
 	}
 
+	mist_env_load_t const* const load = s.env_switching ? &s.preview_load : &s.env_load;
+
+	startup_event("env", "Started loading", load->start_time);
+	startup_event("env", "Mapped assets", load->read_time);
+	startup_event("env", "Decoded assets", load->end_time);
+	startup_event("main", "Joined environment loader", load->join_time);
+	startup_event("main", s.env_switching ? "Created environment preview" : "Created environment");
+
+	// Create frame arena.
+
+	arena_create(&s.frame_arena, FRAME_ARENA_SIZE);
+
+	// Create frame pacer.
+	// This is only started once the session is running.
+
+	frame_pacer_create(&s.frame_pacer);
+
 	// Main loop.
 
 	LOGI("Starting main loop.");
@@ -806,13 +1115,14 @@ void android_main(struct android_app* app) {
 						LOGW("xrBeginSession failed: %d.", res);
 					}
 
-					else {
+					else if (frame_pacer_start(&s.frame_pacer, s.session) == 0) {
 						session_running = true;
 					}
 
 					break;
 				}
 				case XR_SESSION_STATE_STOPPING: {
+					frame_pacer_stop(&s.frame_pacer);
 					XrResult const res = xrEndSession(s.session);
 
 					if (res != XR_SUCCESS) {
@@ -841,17 +1151,40 @@ void android_main(struct android_app* app) {
 			}
 		}
 
-		// Render.
+		// Render the next frame if there's one ready.
+		// Waiting on it is done on the frame pacer's thread; we only wait here long enough not to spin, and go back to polling events if it's not ready by then.
+
+		XrFrameState frame_state;
 
-		if (session_running) {
-			render(&s);
+		if (session_running && frame_pacer_next(&s.frame_pacer, EVENT_POLL_INTERVAL, &frame_state)) {
+			render(&s, frame_state);
 		}
+
+		env_poll(&s);
 	}
 
 	// Cleanup.
 
+	frame_pacer_destroy(&s.frame_pacer);
+
+	arena_destroy(&s.frame_arena);
+
 	desktop_destroy(&s.desktop);
 
+	// If we were in the middle of switching environments, whatever we have of the next one has to be freed too.
+
+	if (s.env_switching) {
+		if (s.next_env_created) {
+			mist_env_destroy(&s.next_env);
+		}
+
+		else {
+			mist_env_cancel(&s.next_env, &s.env_load);
+		}
+	}
+
+	mist_env_destroy(&s.env);
+
 	xrDestroySession(s.session);
 	xrDestroyInstance(inst);
 }
@@ -128,8 +128,13 @@ static inline void matrix_rotate_2d(matrix_t matrix, float vector[2]) {
 	float x = vector[0];
 	float y = vector[1];
 
-	matrix_rotate(matrix, x, (float[]) {0, 1, 0});
-	matrix_rotate(matrix, -y, (float[]) {cos(x), 0, sin(x)});
+	// No compound literals here, as this header is also included from C++.
+
+	float y_axis[] = {0, 1, 0};
+	float tilt_axis[] = {cos(x), 0, sin(x)};
+
+	matrix_rotate(matrix, x, y_axis);
+	matrix_rotate(matrix, -y, tilt_axis);
 }
 
 static inline void matrix_frustum(matrix_t matrix, float tan_left, float tan_right, float tan_up, float tan_down, float near, float far) {
@@ -0,0 +1,231 @@
+#include "pane.h"
+#include "gl_state.h"
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Each LOD level is defined by how many vertices we put on each rounded corner and how many segments we split the centre of the pane into horizontally.
+// Only the horizontal direction needs subdividing as panes are only ever curved around a vertical axis.
+
+static struct {
+	size_t corner_res;
+	size_t segments;
+} const LODS[PANE_LOD_COUNT] = {
+	{ 4,  1},
+	{ 6,  4},
+	{ 8, 12},
+	{12, 24},
+	{16, 48},
+};
+
+void pane_create(pane_t* pane) {
+	pane->index_count = 0;
+
+	glGenVertexArrays(1, &pane->vao);
+	glGenBuffers(1, &pane->vbo);
+	glGenBuffers(1, &pane->ibo);
+}
+
+void pane_destroy(pane_t* pane) {
+	glDeleteVertexArrays(1, &pane->vao);
+	glDeleteBuffers(1, &pane->vbo);
+	glDeleteBuffers(1, &pane->ibo);
+
+	gl_state_reset();
+}
+
+void pane_gen(pane_t* pane, float width, float height, float curve_radius, size_t lod) {
+	assert(lod < PANE_LOD_COUNT);
+
+	size_t const corner_res = LODS[lod].corner_res;
+	size_t const segments = LODS[lod].segments;
+
+	assert(corner_res >= 2);
+	assert(segments >= 1);
+
+	float const centre_width = width - 2 * PANE_CORNER_RADIUS;
+	float const centre_height = height - 2 * PANE_CORNER_RADIUS;
+
+	// The pane is generated as a series of vertical columns going from left to right, which makes it easy to curve.
+	// Each column has 4 vertices: the outer top (on the rim), the inner top (where the rim starts), the inner bottom, and the outer bottom.
+	// The left corner contributes $corner_res - 1 columns, the centre $segments + 1, and the right corner $corner_res - 1 again.
+
+	size_t const column_count = 2 * (corner_res - 1) + segments + 1;
+	size_t const vertex_count = column_count * 4;
+	GLfloat buf[vertex_count][8];
+
+	assert(vertex_count <= 65536); // Because we're using GLushort for the indices.
+
+	// Index buffer: 3 quads (top rim, centre, bottom rim) between each pair of columns.
+
+	size_t const tri_count = (column_count - 1) * 3 * 2;
+	GLushort indices[tri_count][3];
+
+	// Generate the flat columns first.
+	// Columns on the rounded corners follow the arc of the corner, and their normals are bent outwards along the rim to give it a sort of bevel.
+	// Normals on the top rim are flipped vertically, as was the case for the original flat pane.
+
+	for (size_t i = 0; i < column_count; i++) {
+		float x;
+		float outer_y;
+		float outer_nx, outer_ny;
+		float inner_nx, inner_nz;
+
+		if (i < corner_res - 1 || i >= corner_res - 1 + segments + 1) {
+			bool const left = i < corner_res - 1;
+			size_t const arc_i = left ? i : column_count - 1 - i;
+			float const theta = (float) arc_i / (corner_res - 1) * M_PI / 2;
+			float const sign = left ? -1 : 1;
+
+			x = sign * (centre_width / 2 + PANE_CORNER_RADIUS * cos(theta));
+			outer_y = centre_height / 2 + PANE_CORNER_RADIUS * sin(theta);
+
+			outer_nx = sign * cos(theta);
+			outer_ny = sin(theta);
+
+			inner_nx = sign * cos(theta);
+			inner_nz = 1 - cos(theta);
+		}
+
+		else {
+			x = -centre_width / 2 + centre_width * (i - (corner_res - 1)) / segments;
+			outer_y = height / 2;
+
+			outer_nx = 0;
+			outer_ny = 1;
+
+			inner_nx = 0;
+			inner_nz = 1;
+		}
+
+		GLfloat* const outer_top = buf[i * 4 + 0];
+		GLfloat* const inner_top = buf[i * 4 + 1];
+		GLfloat* const inner_bottom = buf[i * 4 + 2];
+		GLfloat* const outer_bottom = buf[i * 4 + 3];
+
+		outer_top[0] = x, outer_top[1] = outer_y;
+		outer_top[5] = outer_nx, outer_top[6] = -outer_ny, outer_top[7] = 0;
+
+		inner_top[0] = x, inner_top[1] = centre_height / 2;
+		inner_top[5] = inner_nx, inner_top[6] = 0, inner_top[7] = inner_nz;
+
+		inner_bottom[0] = x, inner_bottom[1] = -centre_height / 2;
+		inner_bottom[5] = inner_nx, inner_bottom[6] = 0, inner_bottom[7] = inner_nz;
+
+		outer_bottom[0] = x, outer_bottom[1] = -outer_y;
+		outer_bottom[5] = outer_nx, outer_bottom[6] = outer_ny, outer_bottom[7] = 0;
+	}
+
+	// Generate texture coordinates from (flat) vertex positions.
+
+	for (size_t i = 0; i < vertex_count; i++) {
+		float const x = buf[i][0];
+		float const y = buf[i][1];
+
+		buf[i][3] = x / centre_width + .5;
+		buf[i][4] = 1 - (y / centre_height + .5);
+	}
+
+	// Curve everything around the vertical axis.
+	// The X coordinate is taken as an arc length so that the texture isn't stretched.
+
+	for (size_t i = 0; i < vertex_count; i++) {
+		if (curve_radius == 0) {
+			buf[i][2] = 0;
+			continue;
+		}
+
+		float const theta = buf[i][0] / curve_radius;
+		float const s = sin(theta);
+		float const c = cos(theta);
+
+		buf[i][0] = curve_radius * s;
+		buf[i][2] = curve_radius * (1 - c);
+
+		float const nx = buf[i][5];
+		float const nz = buf[i][7];
+
+		buf[i][5] = nx * c - nz * s;
+		buf[i][7] = nx * s + nz * c;
+	}
+
+	// Link up each column with the next.
+
+	for (size_t i = 0; i < column_count - 1; i++) {
+		for (size_t j = 0; j < 3; j++) {
+			GLushort const a_top = i * 4 + j;
+			GLushort const a_bottom = i * 4 + j + 1;
+			GLushort const b_top = (i + 1) * 4 + j;
+			GLushort const b_bottom = (i + 1) * 4 + j + 1;
+
+			GLushort* const tri1 = indices[(i * 3 + j) * 2 + 0];
+			GLushort* const tri2 = indices[(i * 3 + j) * 2 + 1];
+
+			tri1[0] = b_top, tri1[1] = a_top, tri1[2] = a_bottom;
+			tri2[0] = b_top, tri2[1] = a_bottom, tri2[2] = b_bottom;
+		}
+	}
+
+	// Update GL buffers (because we allocated everything on the stack so gotta do this now).
+
+	gl_state_bind_vertex_array(pane->vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, pane->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof buf, buf, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pane->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof indices, indices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof *buf, 0);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof *buf, (void*) 12);
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof *buf, (void*) 20);
+	glEnableVertexAttribArray(2);
+
+	pane->index_count = tri_count * 3;
+}
+
+// Worst-case distance between the tessellated pane and the ideal one.
+// This is the sagitta of the biggest chord we use to approximate either the curve or the corners.
+
+static float lod_error(size_t lod, float width, float curve_radius) {
+	float const corner_step = M_PI / 2 / (LODS[lod].corner_res - 1);
+	float err = PANE_CORNER_RADIUS * (1 - cos(corner_step / 2));
+
+	if (curve_radius != 0) {
+		float const curve_step = width / curve_radius / LODS[lod].segments;
+		float const curve_err = curve_radius * (1 - cos(curve_step / 2));
+
+		err = fmax(err, curve_err);
+	}
+
+	return err;
+}
+
+size_t pane_select_lod(size_t cur_lod, float width, float curve_radius, float dist) {
+	for (size_t lod = 0; lod < PANE_LOD_COUNT - 1; lod++) {
+		float threshold = PANE_LOD_MAX_ERROR;
+
+		if (lod < cur_lod) {
+			threshold *= PANE_LOD_HYSTERESIS;
+		}
+
+		if (lod_error(lod, width, curve_radius) < threshold * dist) {
+			return lod;
+		}
+	}
+
+	return PANE_LOD_COUNT - 1;
+}
+
+void pane_render(pane_t* pane) {
+	gl_state_bind_vertex_array(pane->vao);
+	glDrawElements(GL_TRIANGLES, pane->index_count, GL_UNSIGNED_SHORT, NULL);
+}
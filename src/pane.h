@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glad/gles2.h>
+
+#include <stddef.h>
+
+// Number of tessellation levels we generate for each pane.
+// Level 0 is the coarsest and PANE_LOD_COUNT - 1 the finest.
+
+#define PANE_LOD_COUNT 5
+
+// Maximum angular error (in radians) we tolerate between the tessellated pane and the ideal curved one.
+// This is roughly a pixel on the original Quest.
+
+#define PANE_LOD_MAX_ERROR 1e-3
+
+// Factor applied to the error threshold when considering dropping down to a coarser level, so that we don't flicker between two levels when sitting right at the threshold.
+
+#define PANE_LOD_HYSTERESIS 0.5
+
+// Radius of the rounded corners of panes.
+// The texture only covers the part of the pane inside of these, so the area it's mapped to is 2 * PANE_CORNER_RADIUS smaller than the pane in each direction.
+
+#define PANE_CORNER_RADIUS 0.05
+
+// Texture unit whatever is drawn on a pane (e.g. window contents) is bound to.
+
+#define PANE_TEX_UNIT 1
+
+typedef struct {
+	GLsizei index_count;
+	GLuint vao;
+	GLuint vbo;
+	GLuint ibo;
+} pane_t;
+
+void pane_create(pane_t* pane);
+void pane_destroy(pane_t* pane);
+
+// Generate a pane with rounded corners, curved around a vertical axis 'curve_radius' units in front of it (i.e. on the side its normals face).
+// A 'curve_radius' of 0 gives a flat pane.
+
+void pane_gen(pane_t* pane, float width, float height, float curve_radius, size_t lod);
+size_t pane_select_lod(size_t cur_lod, float width, float curve_radius, float dist);
+void pane_render(pane_t* pane);
@@ -1,30 +1,15 @@
 #include "platform.h"
-#include "win.h"
+#include "gl_state.h"
 
 void platform_create(platform_t* p) {
-	glGenVertexArrays(1, &p->vao);
-	glBindVertexArray(p->vao);
-
-	glGenBuffers(1, &p->vbo);
-	glGenBuffers(1, &p->ibo);
-
-	win_t win = {
-		.vao = p->vao,
-		.vbo = p->vbo,
-		.ibo = p->ibo,
-	};
-
-	gen_pane(&win, 5, 5);
-	p->index_count = win.index_count;
+	pane_create(&p->pane);
+	pane_gen(&p->pane, 5, 5, 0, PANE_LOD_COUNT - 1);
 
 	// TODO Read texture.
 }
 
-void platform_render(platform_t* p, GLuint uniform) {
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glUniform1i(uniform, 1);
+void platform_render(platform_t* p) {
+	gl_state_bind_texture(PANE_TEX_UNIT, 0);
 
-	glBindVertexArray(p->vao);
-	glDrawElements(GL_TRIANGLES, p->index_count, GL_UNSIGNED_BYTE, NULL);
+	pane_render(&p->pane);
 }
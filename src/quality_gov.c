@@ -0,0 +1,72 @@
+#include "quality_gov.h"
+
+void quality_gov_init(quality_gov_t* gov) {
+	gov->level = 0;
+	gov->avg_time = 0;
+	gov->cooldown = 0;
+	gov->headroom = 0;
+}
+
+size_t quality_gov_update(quality_gov_t* gov, uint64_t frame_time, uint64_t budget) {
+	// Smooth out the frame time so we don't react to a single slow frame.
+
+	if (gov->avg_time == 0) {
+		gov->avg_time = frame_time;
+	}
+
+	else {
+		gov->avg_time += (frame_time - gov->avg_time) * QUALITY_GOV_SMOOTHING;
+	}
+
+	float const load = gov->avg_time / budget;
+
+	if (load < QUALITY_GOV_LOW) {
+		gov->headroom++;
+	}
+
+	else {
+		gov->headroom = 0;
+	}
+
+	if (gov->cooldown > 0) {
+		gov->cooldown--;
+		return gov->level;
+	}
+
+	// Pull or release levers one at a time.
+
+	if (load > QUALITY_GOV_HIGH && gov->level < QUALITY_LEVER_COUNT) {
+		gov->level++;
+	}
+
+	else if (gov->headroom >= QUALITY_GOV_HEADROOM_SAMPLES && gov->level > 0) {
+		gov->level--;
+	}
+
+	else {
+		return gov->level;
+	}
+
+	// We don't know how much time the lever will save, so start averaging again from scratch.
+
+	gov->avg_time = 0;
+	gov->cooldown = QUALITY_GOV_COOLDOWN;
+	gov->headroom = 0;
+
+	return gov->level;
+}
+
+char const* quality_lever_name(quality_lever_t lever) {
+	switch (lever) {
+	case QUALITY_LEVER_MIP_BIAS:
+		return "mip bias";
+	case QUALITY_LEVER_TESSELLATION:
+		return "tessellation";
+	case QUALITY_LEVER_UPLOAD_RATE:
+		return "background upload rate";
+	case QUALITY_LEVER_REFRACTION:
+		return "refraction";
+	default:
+		return "unknown";
+	}
+}
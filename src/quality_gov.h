@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Levers the quality governor can pull, in the order it pulls them.
+// They're ordered from least to most noticeable, so that the first ones to go are those nobody will miss.
+
+typedef enum {
+	QUALITY_LEVER_MIP_BIAS,     // Sample the environment from smaller mip levels when refracting it.
+	QUALITY_LEVER_TESSELLATION, // Tolerate more tessellation error when picking pane LOD levels.
+	QUALITY_LEVER_UPLOAD_RATE,  // Only upload the contents of windows we're not looking at every so often.
+	QUALITY_LEVER_REFRACTION,   // Don't refract the environment through windows at all.
+	QUALITY_LEVER_COUNT,
+} quality_lever_t;
+
+// Fractions of the frame budget the (smoothed) frame time has to go over for us to pull the next lever, or under for us to release the last one.
+// The gap between the two is wide, as each lever frees up a fair bit of time and we don't want to flip-flop between levels.
+
+#define QUALITY_GOV_HIGH 0.95
+#define QUALITY_GOV_LOW 0.7
+
+// Number of samples to wait after a change before considering pulling another lever, so that the timings have caught up with the change.
+// Releasing a lever needs there to have been headroom for a lot longer than that.
+
+#define QUALITY_GOV_COOLDOWN 30
+#define QUALITY_GOV_HEADROOM_SAMPLES 180
+
+// Weight of each new sample in the exponential moving average of frame times.
+
+#define QUALITY_GOV_SMOOTHING 0.1
+
+// Quality governor.
+// Like the resolution governor, this is just the policy: it's fed frame times and it's up to the caller to act on which levers are pulled.
+
+typedef struct {
+	size_t level; // Number of levers pulled.
+	float avg_time; // In nanoseconds.
+	size_t cooldown;
+	size_t headroom; // Consecutive samples under QUALITY_GOV_LOW.
+} quality_gov_t;
+
+void quality_gov_init(quality_gov_t* gov);
+
+// Feed in a new frame time sample for a frame with a budget of 'budget' nanoseconds (i.e. the display period).
+// Returns the new level.
+
+size_t quality_gov_update(quality_gov_t* gov, uint64_t frame_time, uint64_t budget);
+
+static inline bool quality_gov_pulled(quality_gov_t const* gov, quality_lever_t lever) {
+	return gov->level > lever;
+}
+
+char const* quality_lever_name(quality_lever_t lever);
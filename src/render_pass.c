@@ -0,0 +1,119 @@
+#include "render_pass.h"
+#include "gl_state.h"
+#include "log.h"
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+// Attachment points we check FBOs for.
+// We only ever use the first colour attachment.
+
+static GLenum const ATTACHMENT_POINTS[] = {
+	GL_COLOR_ATTACHMENT0,
+	GL_DEPTH_ATTACHMENT,
+	GL_STENCIL_ATTACHMENT,
+};
+
+#define ATTACHMENT_POINT_COUNT (sizeof ATTACHMENT_POINTS / sizeof *ATTACHMENT_POINTS)
+
+static render_pass_attachment_t const* find_attachment(render_pass_t const* pass, GLenum attachment) {
+	for (size_t i = 0; i < pass->attachment_count; i++) {
+		if (pass->attachments[i].attachment == attachment) {
+			return &pass->attachments[i];
+		}
+	}
+
+	return NULL;
+}
+
+int render_pass_verify(render_pass_t const* pass, GLuint fbo) {
+	int rv = 0;
+
+	gl_state_bind_framebuffer(fbo);
+
+	for (size_t i = 0; i < ATTACHMENT_POINT_COUNT; i++) {
+		GLenum const point = ATTACHMENT_POINTS[i];
+		GLint type = GL_NONE;
+
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, point, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+
+		bool const present = type != GL_NONE;
+		render_pass_attachment_t const* const attachment = find_attachment(pass, point);
+
+		if (present && attachment == NULL) {
+			LOGE("Render pass '%s': FBO has attachment 0x%x which the pass doesn't say what to do with.", pass->name, point);
+			rv = -1;
+		}
+
+		if (!present && attachment != NULL) {
+			LOGE("Render pass '%s': pass describes attachment 0x%x which the FBO doesn't have.", pass->name, point);
+			rv = -1;
+		}
+
+		if (attachment != NULL && attachment->load == RENDER_PASS_LOAD) {
+			LOGW("Render pass '%s': attachment 0x%x is loaded from memory at the start of the pass.", pass->name, point);
+		}
+	}
+
+	return rv;
+}
+
+void render_pass_begin(render_pass_t const* pass, GLuint fbo, GLsizei x_res, GLsizei y_res) {
+	gl_state_bind_framebuffer(fbo);
+	gl_state_viewport(0, 0, x_res, y_res);
+
+	GLenum invalidate[RENDER_PASS_MAX_ATTACHMENTS];
+	GLsizei invalidate_count = 0;
+	GLbitfield clear_mask = 0;
+
+	for (size_t i = 0; i < pass->attachment_count; i++) {
+		render_pass_attachment_t const* const attachment = &pass->attachments[i];
+
+		if (attachment->load == RENDER_PASS_DONT_CARE) {
+			invalidate[invalidate_count++] = attachment->attachment;
+		}
+
+		if (attachment->load != RENDER_PASS_CLEAR) {
+			continue;
+		}
+
+		switch (attachment->attachment) {
+		case GL_DEPTH_ATTACHMENT:
+			clear_mask |= GL_DEPTH_BUFFER_BIT;
+			break;
+		case GL_STENCIL_ATTACHMENT:
+			clear_mask |= GL_STENCIL_BUFFER_BIT;
+			break;
+		default:
+			clear_mask |= GL_COLOR_BUFFER_BIT;
+			break;
+		}
+	}
+
+	if (invalidate_count > 0) {
+		glInvalidateFramebuffer(GL_FRAMEBUFFER, invalidate_count, invalidate);
+	}
+
+	// Clear the whole attachment rather than just the viewport, as that's what lets the driver skip loading it.
+
+	if (clear_mask != 0) {
+		glClearColor(pass->clear_colour[0], pass->clear_colour[1], pass->clear_colour[2], pass->clear_colour[3]);
+		glClearDepthf(pass->clear_depth);
+		glClear(clear_mask);
+	}
+}
+
+void render_pass_end(render_pass_t const* pass) {
+	GLenum discard[RENDER_PASS_MAX_ATTACHMENTS];
+	GLsizei discard_count = 0;
+
+	for (size_t i = 0; i < pass->attachment_count; i++) {
+		if (pass->attachments[i].store == RENDER_PASS_DISCARD) {
+			discard[discard_count++] = pass->attachments[i].attachment;
+		}
+	}
+
+	if (discard_count > 0) {
+		glInvalidateFramebuffer(GL_FRAMEBUFFER, discard_count, discard);
+	}
+}
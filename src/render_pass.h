@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glad/gles2.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Maximum number of attachments a render pass can describe (colour, depth, stencil).
+
+#define RENDER_PASS_MAX_ATTACHMENTS 3
+
+// What happens to each attachment at the start and the end of a pass.
+// On a tiler, anything which is loaded has to be read from memory into the tile at the start of the pass, and anything which is stored has to be written back at the end.
+// Clearing or not caring about the previous contents avoids the load, and discarding (with glInvalidateFramebuffer) avoids the store.
+
+typedef enum {
+	RENDER_PASS_LOAD,
+	RENDER_PASS_CLEAR,
+	RENDER_PASS_DONT_CARE,
+} render_pass_load_op_t;
+
+typedef enum {
+	RENDER_PASS_STORE,
+	RENDER_PASS_DISCARD,
+} render_pass_store_op_t;
+
+typedef struct {
+	GLenum attachment; // E.g. GL_COLOR_ATTACHMENT0 or GL_DEPTH_ATTACHMENT.
+	render_pass_load_op_t load;
+	render_pass_store_op_t store;
+} render_pass_attachment_t;
+
+typedef struct {
+	char const* name;
+
+	size_t attachment_count;
+	render_pass_attachment_t attachments[RENDER_PASS_MAX_ATTACHMENTS];
+
+	float clear_colour[4];
+	float clear_depth;
+} render_pass_t;
+
+// Check that the pass describes exactly the attachments of an FBO, so nothing ever gets loaded or stored implicitly.
+// Explicit loads are allowed, but warned about.
+// This only uses core GLES 3 queries so it can be checked on any implementation, and should be called once for each FBO the pass is used with.
+// Returns -1 if the pass doesn't match the FBO.
+
+int render_pass_verify(render_pass_t const* pass, GLuint fbo);
+
+// Bind an FBO and set the attachments up according to the load operations.
+
+void render_pass_begin(render_pass_t const* pass, GLuint fbo, GLsizei x_res, GLsizei y_res);
+
+// Discard attachments according to the store operations.
+// The FBO from render_pass_begin must still be bound.
+
+void render_pass_end(render_pass_t const* pass);
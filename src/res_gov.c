@@ -0,0 +1,54 @@
+#include "res_gov.h"
+
+#include <math.h>
+
+void res_gov_init(res_gov_t* gov) {
+	gov->scale = RES_GOV_MAX_SCALE;
+	gov->avg_time = 0;
+	gov->cooldown = 0;
+}
+
+float res_gov_update(res_gov_t* gov, uint64_t gpu_time, uint64_t budget) {
+	// Smooth out the GPU time so we don't react to a single slow frame.
+
+	if (gov->avg_time == 0) {
+		gov->avg_time = gpu_time;
+	}
+
+	else {
+		gov->avg_time += (gpu_time - gov->avg_time) * RES_GOV_SMOOTHING;
+	}
+
+	if (gov->cooldown > 0) {
+		gov->cooldown--;
+		return gov->scale;
+	}
+
+	float const load = gov->avg_time / budget;
+	float scale = gov->scale;
+
+	// GPU time is roughly proportional to the number of pixels, i.e. the square of the scale.
+	// So when we're over, scale down by the square root of how much we need to shed in one go.
+
+	if (load > RES_GOV_HIGH) {
+		scale *= sqrt(RES_GOV_TARGET / load);
+	}
+
+	else if (load < RES_GOV_LOW) {
+		scale += RES_GOV_STEP;
+	}
+
+	scale = fmin(fmax(scale, RES_GOV_MIN_SCALE), RES_GOV_MAX_SCALE);
+
+	if (scale == gov->scale) {
+		return scale;
+	}
+
+	// The average was measured at the old scale, so predict what it'll be at the new one.
+
+	gov->avg_time *= (scale * scale) / (gov->scale * gov->scale);
+	gov->scale = scale;
+	gov->cooldown = RES_GOV_COOLDOWN;
+
+	return scale;
+}
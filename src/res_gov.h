@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounds of the render scale, i.e. the fraction of the swapchain's resolution we actually render at on each axis.
+
+#define RES_GOV_MIN_SCALE 0.5
+#define RES_GOV_MAX_SCALE 1
+
+// Fractions of the frame budget the (smoothed) GPU time has to go over for us to drop resolution, or under for us to raise it back up.
+// Dropping aims for RES_GOV_TARGET, as the GPU time goes roughly with the pixel count.
+
+#define RES_GOV_HIGH 0.9
+#define RES_GOV_TARGET 0.8
+#define RES_GOV_LOW 0.65
+
+// How much to raise the scale by each time there's headroom.
+// This is deliberately much slower than dropping, as a dropped frame is worse than a few frames at a lower resolution.
+
+#define RES_GOV_STEP 0.05
+
+// Number of samples to wait after changing the scale before considering changing it again, so that the timings have caught up with the change.
+
+#define RES_GOV_COOLDOWN 30
+
+// Weight of each new sample in the exponential moving average of GPU times.
+
+#define RES_GOV_SMOOTHING 0.1
+
+// Resolution governor.
+// This is just the policy: it's fed GPU times and doesn't touch GL itself, so it can be driven by simulated timings just as well as by gpu_timer_t.
+
+typedef struct {
+	float scale;
+	float avg_time; // In nanoseconds.
+	size_t cooldown;
+} res_gov_t;
+
+void res_gov_init(res_gov_t* gov);
+
+// Feed in a new GPU time sample for a frame with a budget of 'budget' nanoseconds (i.e. the display period).
+// Returns the new render scale.
+
+float res_gov_update(res_gov_t* gov, uint64_t gpu_time, uint64_t budget);
@@ -1,63 +1,396 @@
 #include "shader.h"
+#include "clock.h"
 #include "log.h"
 
 #include <EGL/egl.h>
 #include <glad/gles2.h>
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static int compile_shader(GLuint shader, char const* src) {
-	int rv = -1;
+// Header of cached program files, followed by the program binary itself.
 
-	glShaderSource(shader, 1, &src, 0);
+#define SHADER_CACHE_MAGIC 0x4D535443 // "MSTC".
+
+typedef struct {
+	uint32_t magic;
+	GLenum format;
+	uint64_t driver_hash;
+	uint64_t key;
+	uint64_t len;
+} cache_header_t;
+
+static char* cache_dir = NULL;
+static uint64_t driver_hash = 0;
+
+// 64-bit FNV-1a, continuing on from 'hash' (which starts off as HASH_INIT).
+
+#define HASH_INIT 0xCBF29CE484222325
+
+static uint64_t hash_str(uint64_t hash, char const* str) {
+	for (; *str; str++) {
+		hash ^= (uint8_t) *str;
+		hash *= 0x100000001B3;
+	}
+
+	// Also hash the terminating null character (XORing it in is a no-op), so that e.g. "ab" + "c" and "a" + "bc" don't hash the same.
+
+	hash *= 0x100000001B3;
+
+	return hash;
+}
+
+static void cache_init(char const* dir) {
+	GLint format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+
+	if (format_count == 0) {
+		LOGW("Driver doesn't support any program binary formats, not caching shaders.");
+		return;
+	}
+
+	free(cache_dir);
+	cache_dir = strdup(dir);
+	assert(cache_dir != NULL);
+
+	// Program binaries are only valid for the exact driver which created them.
+
+	driver_hash = HASH_INIT;
+	driver_hash = hash_str(driver_hash, (char const*) glGetString(GL_VENDOR));
+	driver_hash = hash_str(driver_hash, (char const*) glGetString(GL_RENDERER));
+	driver_hash = hash_str(driver_hash, (char const*) glGetString(GL_VERSION));
+
+	LOGI("Caching shaders in %s (driver hash %016" PRIx64 ").", cache_dir, driver_hash);
+}
+
+static void cache_path(char* path, size_t size, uint64_t key) {
+	snprintf(path, size, "%s/shader_%016" PRIx64 ".bin", cache_dir, key);
+}
+
+// Start loading a program from the cache.
+// Returns 0 if it's not there or is stale (e.g. if the driver was updated).
+// The driver can still reject the binary, which we only find out when checking its link status.
+
+static GLuint cache_load(uint64_t key) {
+	GLuint program = 0;
+	void* buf = NULL;
+
+	char path[256];
+	cache_path(path, sizeof path, key);
+
+	FILE* const fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		return 0;
+	}
+
+	cache_header_t header;
+
+	if (fread(&header, sizeof header, 1, fp) != 1) {
+		goto err;
+	}
+
+	if (header.magic != SHADER_CACHE_MAGIC || header.driver_hash != driver_hash || header.key != key) {
+		LOGI("Cached shader %016" PRIx64 " is stale, recompiling it.", key);
+		goto err;
+	}
+
+	// Don't trust the length in the header, as the file could have been truncated (or otherwise corrupted) while being written.
+	// The binary must be exactly the rest of the file.
+
+	long const start = ftell(fp);
+
+	if (start < 0 || fseek(fp, 0, SEEK_END) != 0) {
+		goto err;
+	}
+
+	long const end = ftell(fp);
+
+	if (end < start || header.len == 0 || header.len != (uint64_t) (end - start) || fseek(fp, start, SEEK_SET) != 0) {
+		LOGW("Cached shader %016" PRIx64 " is corrupt, recompiling it.", key);
+		goto err;
+	}
+
+	buf = malloc(header.len);
+	assert(buf != NULL);
+
+	if (fread(buf, 1, header.len, fp) != header.len) {
+		goto err;
+	}
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.format, buf, header.len);
+
+err:
+
+	free(buf);
+	fclose(fp);
+
+	return program;
+}
+
+// Write a linked program to the cache.
+// This goes through a temporary file, so that we never leave a half-written one behind if we're killed while writing.
+
+static void cache_store(GLuint program, uint64_t key) {
+	GLint len = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+
+	if (len == 0) {
+		return;
+	}
+
+	void* const buf = malloc(len);
+	assert(buf != NULL);
+
+	cache_header_t header = {
+		.magic = SHADER_CACHE_MAGIC,
+		.driver_hash = driver_hash,
+		.key = key,
+	};
+
+	glGetProgramBinary(program, len, &len, &header.format, buf);
+	header.len = len;
+
+	char path[256];
+	cache_path(path, sizeof path, key);
+
+	char tmp_path[260];
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+
+	FILE* const fp = fopen(tmp_path, "wb");
+
+	if (fp == NULL) {
+		LOGW("Failed to open %s for writing.", tmp_path);
+		goto err_open;
+	}
+
+	bool const ok = fwrite(&header, sizeof header, 1, fp) == 1 && fwrite(buf, 1, len, fp) == (size_t) len;
+
+	if (fclose(fp) != 0 || !ok) {
+		LOGW("Failed to write cached shader to %s.", tmp_path);
+		remove(tmp_path);
+		goto err_open;
+	}
+
+	rename(tmp_path, path);
+
+err_open:
+
+	free(buf);
+}
+
+void shader_init(char const* cache_dir) {
+	// Let the driver compile on as many threads as it likes.
+
+	if (GLAD_GL_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+
+	else {
+		LOGW("GL_KHR_parallel_shader_compile not supported, shaders will be compiled whenever the driver feels like it.");
+	}
+
+	cache_init(cache_dir);
+}
+
+// Start compiling a shader, with 'preamble' inserted after the '#version' line of its source (which has to come first).
+// Nothing is queried, so as not to force the driver to finish compiling it there and then.
+
+static GLuint compile_shader(GLenum type, char const* src, char const* preamble) {
+	char const* const version_end = strchr(src, '\n');
+
+	if (version_end == NULL) {
+		LOGW("%s has no '#version' line.", src);
+		return 0;
+	}
+
+	char const* const srcs[] = {src, preamble, version_end + 1};
+	GLint const lens[] = {version_end + 1 - src, -1, -1};
+
+	GLuint const shader = glCreateShader(type);
+
+	glShaderSource(shader, 3, srcs, lens);
 	glCompileShader(shader);
 
+	return shader;
+}
+
+static void log_shader_errors(GLuint shader, char const* src) {
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if (status == GL_TRUE) {
+		return;
+	}
+
 	GLint log_len;
 	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
 
-	char* const log_buf = malloc(log_len); // 'log_len' includes null character.
+	char* const log_buf = malloc(log_len + 1); // 'log_len' includes null character, but may be 0.
+	assert(log_buf != NULL);
+
+	log_buf[0] = '\0';
 	glGetShaderInfoLog(shader, log_len, NULL, log_buf);
 
-	if (log_len) {
-		LOGW("%s failed to compile: %s.", src, log_buf);
-		goto err;
+	LOGW("%s failed to compile: %s.", src, log_buf);
+	free(log_buf);
+}
+
+// Start compiling and linking the job's program from source.
+
+static void job_compile(shader_job_t* job) {
+	job->vert = compile_shader(GL_VERTEX_SHADER, job->vert_src, job->preamble);
+	job->frag = compile_shader(GL_FRAGMENT_SHADER, job->frag_src, job->preamble);
+
+	job->program = glCreateProgram();
+
+	if (job->vert == 0 || job->frag == 0) {
+		return; // Linking will fail and we'll report it then.
 	}
 
-	rv = 0;
+	glAttachShader(job->program, job->vert);
+	glAttachShader(job->program, job->frag);
 
-err:
+	if (cache_dir != NULL) {
+		glProgramParameteri(job->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 
-	free(log_buf);
-	return rv;
+	glLinkProgram(job->program);
 }
 
-GLuint create_shader(char const* vert_src, char const* frag_src) {
-	GLuint const vert = glCreateShader(GL_VERTEX_SHADER);
-	GLuint const frag = glCreateShader(GL_FRAGMENT_SHADER);
+void shader_submit(shader_job_t* job, char const* vert_src, char const* frag_src, size_t define_count, char const* const* defines) {
+	job->start = clock_now();
+	job->vert_src = vert_src;
+	job->frag_src = frag_src;
+	job->vert = 0;
+	job->frag = 0;
+	job->program = 0;
+	job->cached = false;
+
+	// Build the preamble of '#define's for this variant.
 
-	if (compile_shader(vert, vert_src) < 0) {
-		goto error;
+	size_t preamble_len = 1;
+
+	for (size_t i = 0; i < define_count; i++) {
+		preamble_len += strlen("#define \n") + strlen(defines[i]);
 	}
 
-	if (compile_shader(frag, frag_src) < 0) {
-		goto error;
+	job->preamble = malloc(preamble_len);
+	assert(job->preamble != NULL);
+
+	char* cur = job->preamble;
+	*cur = '\0';
+
+	for (size_t i = 0; i < define_count; i++) {
+		cur += sprintf(cur, "#define %s\n", defines[i]);
 	}
 
-	GLuint const program = glCreateProgram();
+	// Look for it in the cache first.
+
+	job->key = HASH_INIT;
 
-	glAttachShader(program, vert);
-	glAttachShader(program, frag);
+	job->key = hash_str(job->key, vert_src);
+	job->key = hash_str(job->key, job->preamble);
+	job->key = hash_str(job->key, frag_src);
+
+	if (cache_dir != NULL) {
+		job->program = cache_load(job->key);
+		job->cached = job->program != 0;
+	}
+
+	if (!job->cached) {
+		job_compile(job);
+	}
+}
+
+bool shader_ready(shader_job_t* job) {
+	if (!GLAD_GL_KHR_parallel_shader_compile) {
+		return true;
+	}
+
+	GLint done;
+	glGetProgramiv(job->program, GL_COMPLETION_STATUS_KHR, &done);
+
+	return done == GL_TRUE;
+}
+
+GLuint shader_finish(shader_job_t* job) {
+	GLuint program = job->program;
+
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	// If the driver rejected the cached binary, fall back to compiling it.
+	// We have no choice but to wait on this one.
+
+	if (status != GL_TRUE && job->cached) {
+		LOGI("Driver rejected cached shader %016" PRIx64 ", recompiling it.", job->key);
+		glDeleteProgram(program);
+
+		job->cached = false;
+		job_compile(job);
+
+		program = job->program;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+	}
+
+	if (status != GL_TRUE) {
+		LOGW("Failed to link shader %016" PRIx64 ".", job->key);
+
+		if (job->vert != 0) {
+			log_shader_errors(job->vert, job->vert_src);
+		}
+
+		if (job->frag != 0) {
+			log_shader_errors(job->frag, job->frag_src);
+		}
+
+		glDeleteProgram(program);
+		program = 0;
+	}
+
+	else if (!job->cached && cache_dir != NULL) {
+		cache_store(program, job->key);
+	}
+
+	// The program keeps what it needs once linked, so the shaders themselves can go.
+	// Deleting a shader which is still attached only flags it for deletion, so there's no need to detach them first.
+
+	glDeleteShader(job->vert);
+	glDeleteShader(job->frag);
+
+	if (program != 0) {
+		LOGI("%s shader %016" PRIx64 " in %.2f ms.", job->cached ? "Loaded cached" : "Compiled", job->key, (clock_now() - job->start) / 1e6);
+	}
+
+	free(job->preamble);
+	job->preamble = NULL;
 
-	glLinkProgram(program);
 	return program;
+}
+
+void shader_cancel(shader_job_t* job) {
+	glDeleteShader(job->vert);
+	glDeleteShader(job->frag);
+	glDeleteProgram(job->program);
 
-error:
+	free(job->preamble);
+	job->preamble = NULL;
+}
+
+GLuint create_shader(char const* vert_src, char const* frag_src) {
+	return create_shader_variant(vert_src, frag_src, 0, NULL);
+}
 
-	glDeleteShader(vert);
-	glDeleteShader(frag);
+GLuint create_shader_variant(char const* vert_src, char const* frag_src, size_t define_count, char const* const* defines) {
+	shader_job_t job;
 
-	return 0;
+	shader_submit(&job, vert_src, frag_src, define_count, defines);
+	return shader_finish(&job);
 }
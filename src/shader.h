@@ -2,4 +2,61 @@
 
 #include <glad/gles2.h>
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Set up shader creation, which must be done once the GL context is current.
+// Linked programs are cached as files in 'cache_dir' (e.g. the app's files directory), so that later launches can load them instead of compiling them again.
+// Cached programs are keyed by a hash of their sources, and are only used if they come from the same driver.
+
+void shader_init(char const* cache_dir);
+
+// A program being compiled (or loaded from the cache) in the background.
+// Its sources aren't copied, so they must outlive it.
+
+typedef struct {
+	char const* vert_src;
+	char const* frag_src;
+	char* preamble;
+
+	uint64_t key;
+	uint64_t start;
+	bool cached;
+
+	GLuint vert;
+	GLuint frag;
+	GLuint program;
+} shader_job_t;
+
+// Start creating a program from the sources of its vertex and fragment shaders, which must both start with a '#version' line.
+// Each of the 'define_count' preprocessor symbols in 'defines' is defined in both stages (right after the '#version' line).
+// This is how shader variants are specialized: features are #ifdef'd in the source, and each variant is compiled with the set of features it needs.
+
+void shader_submit(shader_job_t* job, char const* vert_src, char const* frag_src, size_t define_count, char const* const* defines);
+
+// Whether the job is done, without blocking.
+// This relies on GL_KHR_parallel_shader_compile; without it there's no way of knowing, so this always says it is.
+
+bool shader_ready(shader_job_t* job);
+
+// Wait for the job to be done and return the program, or 0 if it failed.
+
+GLuint shader_finish(shader_job_t* job);
+
+// Throw away a job which hasn't been finished.
+
+void shader_cancel(shader_job_t* job);
+
+// Create a program and wait for it to be done.
+
 GLuint create_shader(char const* vert_src, char const* frag_src);
+GLuint create_shader_variant(char const* vert_src, char const* frag_src, size_t define_count, char const* const* defines);
+
+#if defined(__cplusplus)
+}
+#endif
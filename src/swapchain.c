@@ -0,0 +1,159 @@
+#include "swapchain.h"
+#include "gl_state.h"
+#include "log.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+int swapchain_create(swapchain_t* swapchain, XrSession sesh, XrSwapchainCreateInfo const* create_info) {
+	swapchain->x_res = create_info->width;
+	swapchain->y_res = create_info->height;
+	swapchain->image_count = 0;
+	swapchain->images = NULL;
+	swapchain->fbos = NULL;
+	swapchain->attached_depth = NULL;
+
+	if (xrCreateSwapchain(sesh, create_info, &swapchain->swapchain) != XR_SUCCESS) {
+		LOGE("Failed to create swapchain.");
+		swapchain->swapchain = XR_NULL_HANDLE;
+		return -1;
+	}
+
+	// Get images.
+
+	uint32_t image_count = 0;
+
+	if (xrEnumerateSwapchainImages(swapchain->swapchain, 0, &image_count, NULL) != XR_SUCCESS) {
+		LOGE("Failed to enumerate swapchain images.");
+		goto err;
+	}
+
+	XrSwapchainImageOpenGLESKHR* const images = calloc(image_count, sizeof *images);
+	assert(images != NULL);
+
+	for (size_t i = 0; i < image_count; i++) {
+		images[i].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
+	}
+
+	if (
+		xrEnumerateSwapchainImages(
+			swapchain->swapchain,
+			image_count,
+			&image_count,
+			(XrSwapchainImageBaseHeader*) images
+		) != XR_SUCCESS
+	) {
+		LOGE("Failed to enumerate swapchain images.");
+		free(images);
+		goto err;
+	}
+
+	swapchain->image_count = image_count;
+	swapchain->images = calloc(image_count, sizeof *swapchain->images);
+	assert(swapchain->images != NULL);
+
+	for (size_t i = 0; i < image_count; i++) {
+		swapchain->images[i] = (GLuint) images[i].image;
+	}
+
+	free(images);
+
+	// Give them all FBOs.
+
+	swapchain->fbos = calloc(image_count, sizeof *swapchain->fbos);
+	assert(swapchain->fbos != NULL);
+
+	glGenFramebuffers(image_count, swapchain->fbos);
+
+	swapchain->attached_depth = calloc(image_count, sizeof *swapchain->attached_depth);
+	assert(swapchain->attached_depth != NULL);
+
+	return 0;
+
+err:
+
+	xrDestroySwapchain(swapchain->swapchain);
+	swapchain->swapchain = XR_NULL_HANDLE;
+
+	return -1;
+}
+
+void swapchain_destroy(swapchain_t* swapchain) {
+	if (swapchain->swapchain == XR_NULL_HANDLE) {
+		return;
+	}
+
+	glDeleteFramebuffers(swapchain->image_count, swapchain->fbos);
+	xrDestroySwapchain(swapchain->swapchain);
+
+	free(swapchain->images);
+	free(swapchain->fbos);
+	free(swapchain->attached_depth);
+
+	swapchain->swapchain = XR_NULL_HANDLE;
+
+	// The FBOs we just deleted might have been bound.
+
+	gl_state_reset();
+}
+
+bool swapchain_format_supported(XrSession sesh, int64_t format) {
+	uint32_t format_count = 0;
+
+	if (xrEnumerateSwapchainFormats(sesh, 0, &format_count, NULL) != XR_SUCCESS) {
+		LOGW("Couldn't get swapchain formats.");
+		return false;
+	}
+
+	int64_t* const formats = calloc(format_count, sizeof *formats);
+	assert(formats != NULL);
+
+	bool supported = false;
+
+	if (xrEnumerateSwapchainFormats(sesh, format_count, &format_count, formats) != XR_SUCCESS) {
+		LOGW("Couldn't get swapchain formats.");
+		goto done;
+	}
+
+	for (size_t i = 0; i < format_count; i++) {
+		if (formats[i] == format) {
+			supported = true;
+			break;
+		}
+	}
+
+done:
+
+	free(formats);
+	return supported;
+}
+
+int swapchain_acquire(swapchain_t* swapchain, uint32_t* img_i) {
+	XrSwapchainImageAcquireInfo acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+
+	if (xrAcquireSwapchainImage(swapchain->swapchain, &acquire_info, img_i) != XR_SUCCESS) {
+		LOGE("Failed to acquire swapchain.");
+		return -1;
+	}
+
+	XrSwapchainImageWaitInfo wait_info = {
+		.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
+		.timeout = XR_INFINITE_DURATION,
+	};
+
+	if (xrWaitSwapchainImage(swapchain->swapchain, &wait_info) != XR_SUCCESS) {
+		LOGE("Failed to wait for swapchain.");
+		swapchain_release(swapchain);
+		return -1;
+	}
+
+	return 0;
+}
+
+void swapchain_release(swapchain_t* swapchain) {
+	XrSwapchainImageReleaseInfo release_info = {XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+
+	if (xrReleaseSwapchainImage(swapchain->swapchain, &release_info) != XR_SUCCESS) {
+		LOGE("Failed to release swapchain.");
+	}
+}
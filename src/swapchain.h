@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <jni.h>
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+#define XR_USE_PLATFORM_ANDROID
+#define XR_USE_GRAPHICS_API_OPENGL_ES
+
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+typedef struct {
+	XrSwapchain swapchain;
+
+	uint32_t x_res;
+	uint32_t y_res;
+
+	size_t image_count;
+	GLuint* images;
+	GLuint* fbos;
+
+	// Depth image currently attached to each FBO, if any.
+	// Depth images are acquired separately from colour images, so this is how the caller knows when to reattach them.
+
+	GLuint* attached_depth;
+} swapchain_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Create a swapchain and get its images.
+// An FBO is generated for each image, but it's up to the caller to attach the images to them (as this depends on e.g. whether we're using multiview).
+
+int swapchain_create(swapchain_t* swapchain, XrSession sesh, XrSwapchainCreateInfo const* create_info);
+void swapchain_destroy(swapchain_t* swapchain);
+
+// Whether the runtime can create swapchains in a given format.
+
+bool swapchain_format_supported(XrSession sesh, int64_t format);
+
+int swapchain_acquire(swapchain_t* swapchain, uint32_t* img_i);
+void swapchain_release(swapchain_t* swapchain);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,132 @@
+#include "ubo_ring.h"
+#include "log.h"
+
+#include <EGL/egl.h>
+#include <glad/gles2.h>
+
+#include <assert.h>
+
+// Initial segment size.
+// This is enough for the per-frame blocks and a dozen or so windows, and segments grow past that as needed.
+
+#define INITIAL_SEG_SIZE 4096
+
+// How long to wait on the GPU to be done with a segment before giving up and using it anyway, in nanoseconds.
+
+#define FENCE_TIMEOUT 100000000
+
+static void delete_fences(ubo_ring_t* ring) {
+	for (size_t i = 0; i < UBO_RING_SEGMENTS; i++) {
+		if (ring->fences[i] != 0) {
+			glDeleteSync(ring->fences[i]);
+			ring->fences[i] = 0;
+		}
+	}
+}
+
+void ubo_ring_create(ubo_ring_t* ring) {
+	ring->align = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring->align);
+
+	ring->seg_size = INITIAL_SEG_SIZE;
+	ring->seg = 0;
+	ring->used = 0;
+	ring->map = NULL;
+
+	for (size_t i = 0; i < UBO_RING_SEGMENTS; i++) {
+		ring->fences[i] = 0;
+	}
+
+	glGenBuffers(1, &ring->ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->ubo);
+	glBufferData(GL_UNIFORM_BUFFER, ring->seg_size * UBO_RING_SEGMENTS, NULL, GL_DYNAMIC_DRAW);
+}
+
+void ubo_ring_destroy(ubo_ring_t* ring) {
+	delete_fences(ring);
+	glDeleteBuffers(1, &ring->ubo);
+}
+
+size_t ubo_ring_stride(ubo_ring_t* ring, size_t size) {
+	size_t const align = ring->align;
+	return (size + align - 1) / align * align;
+}
+
+int ubo_ring_begin(ubo_ring_t* ring, size_t size) {
+	assert(ring->map == NULL);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->ubo);
+
+	// Everything using the last segment has been issued by now, so fence it.
+
+	if (ring->fences[ring->seg] == 0) {
+		ring->fences[ring->seg] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// If the segments are too small, reallocate the whole buffer.
+	// The old storage is orphaned, so the driver keeps it around for as long as the GPU is still using it, and the new storage isn't being used by anything.
+
+	if (size > ring->seg_size) {
+		while (ring->seg_size < size) {
+			ring->seg_size *= 2;
+		}
+
+		LOGI("Growing uniform buffer ring segments to %zu bytes.", ring->seg_size);
+		glBufferData(GL_UNIFORM_BUFFER, ring->seg_size * UBO_RING_SEGMENTS, NULL, GL_DYNAMIC_DRAW);
+
+		delete_fences(ring);
+	}
+
+	ring->seg = (ring->seg + 1) % UBO_RING_SEGMENTS;
+	ring->used = 0;
+
+	// Make sure the GPU is done with the segment we're about to write.
+
+	GLsync const fence = ring->fences[ring->seg];
+
+	if (fence != 0) {
+		if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED) {
+			LOGW("Timed out waiting for the GPU to be done with a uniform buffer ring segment.");
+		}
+
+		glDeleteSync(fence);
+		ring->fences[ring->seg] = 0;
+	}
+
+	GLbitfield const access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	ring->map = glMapBufferRange(GL_UNIFORM_BUFFER, ring->seg * ring->seg_size, ring->seg_size, access);
+
+	if (ring->map == NULL) {
+		LOGE("Failed to map uniform buffer ring segment.");
+		return -1;
+	}
+
+	return 0;
+}
+
+void ubo_ring_end(ubo_ring_t* ring) {
+	if (ring->map == NULL) {
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->ubo);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+	ring->map = NULL;
+}
+
+void* ubo_ring_alloc(ubo_ring_t* ring, size_t size, GLintptr* offset) {
+	size_t const stride = ubo_ring_stride(ring, size);
+
+	if (ring->map == NULL) {
+		return NULL;
+	}
+
+	assert(ring->used + stride <= ring->seg_size);
+
+	void* const ptr = ring->map + ring->used;
+	*offset = ring->seg * ring->seg_size + ring->used;
+
+	ring->used += stride;
+	return ptr;
+}
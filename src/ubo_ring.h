@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glad/gles2.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of frames' worth of uniform data we keep around.
+// The GPU can still be reading from the last couple of frames' data while we write the next, so we never write to a segment it might still be using.
+
+#define UBO_RING_SEGMENTS 3
+
+// A uniform buffer split into a segment per frame in flight.
+// Each frame, the next segment is mapped and uniform blocks are sub-allocated from it, to then be bound by offset.
+// Segments are mapped unsynchronized, so each one is fenced once the frame which used it has been issued, and we wait on that fence before reusing it.
+// Normally, nothing in flight is still using it by then so this never stalls, but nothing else guarantees how many frames are in flight.
+
+typedef struct {
+	GLuint ubo;
+	GLint align;
+
+	size_t seg_size;
+	size_t seg;
+
+	size_t used;
+	uint8_t* map;
+
+	GLsync fences[UBO_RING_SEGMENTS];
+} ubo_ring_t;
+
+void ubo_ring_create(ubo_ring_t* ring);
+void ubo_ring_destroy(ubo_ring_t* ring);
+
+// Size a block actually takes up in the ring once aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+
+size_t ubo_ring_stride(ubo_ring_t* ring, size_t size);
+
+// Move on to the next segment and map it, growing the ring if a segment is smaller than 'size' bytes.
+// Returns -1 if mapping failed, in which case nothing can be allocated this frame.
+
+int ubo_ring_begin(ubo_ring_t* ring, size_t size);
+void ubo_ring_end(ubo_ring_t* ring);
+
+// Allocate a block of 'size' bytes in the current segment.
+// Returns where to write it to (or NULL if the segment couldn't be mapped), and its offset in the buffer for binding it.
+
+void* ubo_ring_alloc(ubo_ring_t* ring, size_t size, GLintptr* offset);
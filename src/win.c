@@ -1,4 +1,5 @@
 #include "win.h"
+#include "gl_state.h"
 #include "log.h"
 
 #include <EGL/egl.h>
@@ -8,272 +9,108 @@
 #include <math.h>
 #include <stdlib.h>
 
-void gen_pane(win_t* win, float width, float height) {
-	// This is sort of a cursed function, I know.
-
-	float const radius = 0.05;
-
-#define M_TAU (2 * M_PI)
-#define CORNER_RESOLUTION 16
-
-	assert(CORNER_RESOLUTION >= 2);
-	// assert(radius * 2 < width);
-	// assert(radius * 2 < height);
-
-	// Vertex buffer: 4 for the centre quad, then $CORNER_RESOLUTION vertices for each of the 4 corners.
-
-	size_t const vertex_count = 4 + 4 * CORNER_RESOLUTION;
-	GLfloat buf[vertex_count][8];
-
-	assert(vertex_count <= 256); // Because we're using GLbyte for the indices.
-
-	// Index buffer: 2 tris for the centre quad, 2 tris for each of the 4 edges, and 1 tri for $CORNER_RESOLUTION - 1 for each of the 4 corners.
-
-	size_t const tri_count = 2 + 4 * 2 + 4 * (CORNER_RESOLUTION - 1);
-	GLbyte indices[tri_count][3];
-
-	float const centre_width = width - 2 * radius;
-	float const centre_height = height - 2 * radius;
-
-	// Add the centre quad.
-	// It's normals will be facing us.
+void win_create(win_t* win) {
+	win->rot = 0;
+	win->height = 0;
+	win->target_height = 1;
 
-	buf[0][0] = centre_width / 2, buf[0][1] = centre_height / 2;
-	buf[1][0] = -centre_width / 2, buf[1][1] = centre_height / 2;
-	buf[2][0] = -centre_width / 2, buf[2][1] = -centre_height / 2;
-	buf[3][0] = centre_width / 2, buf[3][1] = -centre_height / 2;
+	// Create meshes for each LOD level.
+	// They'll actually be generated once we know the size of the window.
 
-	for (size_t i = 0; i < 4; i++) {
-		buf[i][5] = 0, buf[i][6] = 0, buf[i][7] = 1;
+	for (size_t i = 0; i < PANE_LOD_COUNT; i++) {
+		pane_create(&win->panes[i]);
 	}
 
-	indices[0][0] = 0, indices[0][1] = 1, indices[0][2] = 2;
-	indices[1][0] = 0, indices[1][1] = 2, indices[1][2] = 3;
+	win->pane_x_res = 0;
+	win->pane_y_res = 0;
+	win->lod = PANE_LOD_COUNT - 1;
 
-	// Add corners to edge triangles already.
-	// We'll add the ends of the triangle fans for the corners later.
-
-	indices[2][0] = 0, indices[2][1] = 1, indices[3][0] = 1; // Top edge.
-	indices[4][0] = 1, indices[4][1] = 2, indices[5][0] = 2; // Left edge.
-	indices[6][0] = 2, indices[6][1] = 3, indices[7][0] = 2; // Bottom edge.
-	indices[8][0] = 3, indices[8][1] = 0, indices[9][0] = 3; // Right edge.
-
-	// Go through all angles and add vertex data for each vertex.
-
-	size_t buf_off = 4;
-	size_t tri_off = 2 + 4 * 2; // Reserve space for edge triangles.
-
-	for (size_t i = 0; i < CORNER_RESOLUTION; i++) {
-		float const theta = (float) i / (CORNER_RESOLUTION - 1) * M_TAU / 4;
-
-		float const nx = cos(theta);
-		float const ny = sin(theta);
-
-		float const dist_x = centre_width / 2 + radius * nx;
-		float const dist_y = centre_height / 2 + radius * ny;
-
-		// Top right.
-
-		buf[buf_off][0] = dist_x, buf[buf_off][1] = dist_y;
-		buf[buf_off][5] = nx, buf[buf_off][6] = -ny, buf[buf_off][7] = 0;
-
-		if (i != 0) { // Corner triangle fan.
-			indices[tri_off][0] = 0;
-			indices[tri_off][1] = buf_off - 4;
-			indices[tri_off][2] = buf_off;
-
-			tri_off++;
-		}
-
-		if (i == 0) {                               // Edge tris.
-			indices[8][2] = indices[9][1] = buf_off; // Right edge.
-		}
-
-		if (i == CORNER_RESOLUTION - 1) {           // Edge tris.
-			indices[2][2] = indices[3][1] = buf_off; // Top edge.
-		}
-
-		buf_off++;
-
-		// Top left.
-
-		buf[buf_off][0] = -dist_x, buf[buf_off][1] = dist_y;
-		buf[buf_off][5] = -nx, buf[buf_off][6] = -ny, buf[buf_off][7] = 0;
-
-		if (i != 0) { // Corner triangle fan.
-			indices[tri_off][0] = 1;
-			indices[tri_off][1] = buf_off - 4;
-			indices[tri_off][2] = buf_off;
-
-			tri_off++;
-		}
-
-		if (i == 0) {                               // Edge tris.
-			indices[4][2] = indices[5][1] = buf_off; // Left edge.
-		}
-
-		if (i == CORNER_RESOLUTION - 1) { // Edge tris.
-			indices[3][2] = buf_off;       // Top edge.
-		}
-
-		buf_off++;
-
-		// Bottom left.
-
-		buf[buf_off][0] = -dist_x, buf[buf_off][1] = -dist_y;
-		buf[buf_off][5] = -nx, buf[buf_off][6] = ny, buf[buf_off][7] = 0;
-
-		if (i != 0) { // Corner triangle fan.
-			indices[tri_off][0] = 2;
-			indices[tri_off][1] = buf_off - 4;
-			indices[tri_off][2] = buf_off;
-
-			tri_off++;
-		}
-
-		if (i == 0) {               // Edge tris.
-			indices[5][2] = buf_off; // Left edge.
-		}
-
-		if (i == CORNER_RESOLUTION - 1) { // Edge tris.
-			indices[7][1] = buf_off;       // Bottom edge.
-		}
-
-		buf_off++;
-
-		// Bottom right.
+	// Create window texture.
+	// Its parameters never change, so set them once here rather than every time it's drawn.
 
-		buf[buf_off][0] = dist_x, buf[buf_off][1] = -dist_y;
-		buf[buf_off][5] = nx, buf[buf_off][6] = ny, buf[buf_off][7] = 0;
+	glGenTextures(1, &win->tex);
+	gl_state_bind_texture(PANE_TEX_UNIT, win->tex);
 
-		if (i != 0) { // Corner triangle fan.
-			indices[tri_off][0] = 3;
-			indices[tri_off][1] = buf_off - 4;
-			indices[tri_off][2] = buf_off;
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, (float[]) {0, 0, 0, 0});
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
-			tri_off++;
-		}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-		if (i == 0) {               // Edge tris.
-			indices[9][2] = buf_off; // Right edge.
-		}
+	win->dirty = true;
+}
 
-		if (i == CORNER_RESOLUTION - 1) {           // Edge tris.
-			indices[7][2] = indices[6][2] = buf_off; // Bottom edge.
-		}
+void win_destroy(win_t* win) {
+	glDeleteTextures(1, &win->tex);
+	swapchain_destroy(&win->swapchain);
+	gl_state_reset();
 
-		buf_off++;
+	for (size_t i = 0; i < PANE_LOD_COUNT; i++) {
+		pane_destroy(&win->panes[i]);
 	}
 
-	// Everything is at the same Z coord.
-
-	for (size_t i = 0; i < vertex_count; i++) {
-		buf[i][2] = 0;
-	}
+	free(win->fb_data);
+	free(win->translucent_tiles);
+}
 
-	// Generate texture coordinates from vertex positions.
+void win_select_lod(win_t* win, float dist) {
+	float const width = (float) win->x_res / WIN_PIXELS_PER_UNIT;
+	win->lod = pane_select_lod(win->lod, width, WIN_CURVE_RADIUS, dist);
+}
 
-	for (size_t i = 0; i < vertex_count; i++) {
-		float const x = buf[i][0];
-		float const y = buf[i][1];
+bool win_opaque(win_t* win) {
+	return win->tiles_x != 0 && win->translucent_tile_count == 0;
+}
 
-		buf[i][3] = x / (width - radius * 2) + .5;
-		buf[i][4] = 1 - (y / (height - radius * 2) + .5);
+bool win_upload(win_t* win) {
+	if (!win->dirty) {
+		return false;
 	}
 
-	// Update GL buffers (because we allocated everything on the stack so gotta do this now).
-
-	glBindBuffer(GL_ARRAY_BUFFER, win->vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof buf, buf, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, win->ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof indices, indices, GL_STATIC_DRAW);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof *buf, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof *buf, (void*) 12);
-	glEnableVertexAttribArray(1);
+	// No mipmaps, as the texture is only ever sampled with GL_LINEAR.
 
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof *buf, (void*) 20);
-	glEnableVertexAttribArray(2);
-
-	win->index_count = tri_count * 3;
+	gl_state_bind_texture(PANE_TEX_UNIT, win->tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, win->x_res, win->y_res, 0, GL_RGBA, GL_UNSIGNED_BYTE, win->fb_data);
 
-#if 0
-	// Print to Python lists which we can use for easy debugging.
+	win->dirty = false;
+	return true;
+}
 
-	printf("buf = [\n\t");
+float win_bounding_radius(win_t* win) {
+	// Curving the pane only ever brings its points closer to the centre, so the half-diagonal of the flat pane is enough.
 
-	for (size_t i = 0; i < vertex_count; i++) {
-		for (size_t j = 0; j < sizeof *buf / sizeof **buf; j++) {
-			printf("%.3f, ", buf[i][j]);
-		}
+	float const width = (float) win->x_res / WIN_PIXELS_PER_UNIT;
+	float const height = (float) win->y_res / WIN_PIXELS_PER_UNIT * win->height;
 
-		printf("\n\t");
-	}
+	return sqrt(width * width + height * height) / 2;
+}
 
-	printf("]\n");
+void win_update(win_t* win, float dt) {
+	// Regenerate all the meshes up front if the window changed size, so that switching LOD level later on never has to wait on this.
 
-	printf("indices = [\n\t");
+	if (win->x_res != win->pane_x_res || win->y_res != win->pane_y_res) {
+		float const width = (float) win->x_res / WIN_PIXELS_PER_UNIT;
+		float const height = (float) win->y_res / WIN_PIXELS_PER_UNIT;
 
-	for (size_t i = 0; i < tri_count; i++) {
-		for (size_t j = 0; j < sizeof *indices / sizeof **indices; j++) {
-			printf("%d, ", indices[i][j]);
+		for (size_t i = 0; i < PANE_LOD_COUNT; i++) {
+			pane_gen(&win->panes[i], width, height, WIN_CURVE_RADIUS, i);
 		}
 
-		printf("\n\t");
+		win->pane_x_res = win->x_res;
+		win->pane_y_res = win->y_res;
 	}
 
-	printf("]\n");
-#endif
-}
-
-void win_create(win_t* win) {
-	win->rot = 0;
-	win->height = 0;
-	win->target_height = 1;
-
-	// Create VAO, VBO, and IBO.
-
-	glGenVertexArrays(1, &win->vao);
-	glBindVertexArray(win->vao);
-
-	glGenBuffers(1, &win->vbo);
-	glGenBuffers(1, &win->ibo);
-
-	// Create window texture.
-
-	glGenTextures(1, &win->tex);
-}
+	// Animate.
+	// This is framerate-independent, so should be the same regardless of how long a frame took.
 
-void win_destroy(win_t* win) {
-	glDeleteTextures(1, &win->tex);
-	glDeleteVertexArrays(1, &win->vao);
-	glDeleteBuffers(1, &win->vbo);
-	glDeleteBuffers(1, &win->ibo);
+	float const t = 1 - exp(-dt * WIN_ANIM_SPEED);
 
-	free(win->fb_data);
+	win->rot += (win->target_rot - win->rot) * t;
+	win->height += (win->target_height - win->height) * t;
 }
 
-void win_render(win_t* win, GLuint uniform) {
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, win->tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, win->x_res, win->y_res, 0, GL_RGBA, GL_UNSIGNED_BYTE, win->fb_data);
-	glGenerateMipmap(GL_TEXTURE_2D); // TODO Necessary?
-	gen_pane(win, (float) win->x_res / 300, (float) win->y_res / 300);
-
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, (float[]) {0, 0, 0, 0});
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glUniform1i(uniform, 1);
-
-	glBindVertexArray(win->vao);
-	glDrawElements(GL_TRIANGLES, win->index_count, GL_UNSIGNED_BYTE, NULL);
+void win_render(win_t* win) {
+	gl_state_bind_texture(PANE_TEX_UNIT, win->tex);
 
-	win->rot += (win->target_rot - win->rot) * 0.1;
-	win->height += (win->target_height - win->height) * 0.1;
+	pane_render(&win->panes[win->lod]);
 }
@@ -1,9 +1,27 @@
 #pragma once
 
+#include "matrix.h"
+#include "pane.h"
+#include "swapchain.h"
+
 #include <glad/gles2.h>
 
 #include <stdbool.h>
 
+// Windows are curved around the user.
+// This is roughly the distance between them and the windows.
+
+#define WIN_CURVE_RADIUS 3
+
+// Windows are 300 pixels to a unit.
+
+#define WIN_PIXELS_PER_UNIT 300
+
+// How quickly windows animate towards their target state.
+// This is the inverse of the time constant (in seconds) of the exponential decay.
+
+#define WIN_ANIM_SPEED 15
+
 typedef struct {
 	bool created;
 	bool destroyed;
@@ -14,21 +32,70 @@ typedef struct {
 	uint32_t y_res;
 	void* fb_data;
 
+	// Set whenever the contents of 'fb_data' change, so we know to upload them again.
+
+	bool dirty;
+
+	// Bitmap of the tiles 'fb_data' was last sent in which have any translucent pixels (see win_opaque).
+
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	uint64_t* translucent_tiles;
+	size_t translucent_tile_count;
+
 	GLuint tex;
-	GLsizei index_count;
-	GLuint vao;
-	GLuint vbo;
-	GLuint ibo;
+
+	// Meshes for each LOD level, so we can switch between them on the fly.
+	// These are regenerated whenever the window changes size.
+
+	pane_t panes[PANE_LOD_COUNT];
+	uint32_t pane_x_res;
+	uint32_t pane_y_res;
+	size_t lod;
 
 	float rot;
 	float target_rot;
 
 	float height;
 	float target_height;
-} win_t;
 
-void gen_pane(win_t* win, float width, float height);
+	// Computed once per frame in the scene update.
+	// 'visible_views' is a bitmask of the views the window is in the frustum of.
+
+	matrix_t model;
+	uint32_t visible_views;
+
+	// Offset of the window's uniform block in the desktop's uniform buffer ring for this frame.
+
+	GLintptr ubo_offset;
+
+	// Swapchain for when windows are submitted as their own composition layer.
+	// It can't be submitted before it's been written to at least once.
+
+	swapchain_t swapchain;
+	bool layer_ready;
+
+	// Whether the window is submitted as its own layer this frame.
+	// Windows past the runtime's layer limit are drawn into the projection layer instead.
+
+	bool own_layer;
+} win_t;
 
 void win_create(win_t* win);
 void win_destroy(win_t* win);
-void win_render(win_t* win, GLuint uniform);
+void win_update(win_t* win, float dt);
+
+// Upload the window's contents if they changed since the last upload.
+// Returns whether they did.
+
+bool win_upload(win_t* win);
+
+// Radius of a sphere around the centre of the window (i.e. the translation of its model matrix) which contains all of it.
+
+float win_bounding_radius(win_t* win);
+void win_select_lod(win_t* win, float dist);
+
+// Whether every pixel of the window is fully opaque, in which case nothing behind it can be seen.
+
+bool win_opaque(win_t* win);
+void win_render(win_t* win);
@@ -0,0 +1,143 @@
+// Drive the resolution governor with simulated GPU times and check the render scales it picks.
+// GPU time is modelled as proportional to the number of pixels rendered, i.e. to the square of the scale, which is what the governor assumes too.
+
+#include "res_gov.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define BUDGET 13888889 // 72 Hz, in nanoseconds.
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                    \
+	do {                                                     \
+		if (!(cond)) {                                        \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);    \
+			fprintf(stderr, __VA_ARGS__);                      \
+			fprintf(stderr, "\n");                             \
+			failures++;                                        \
+		}                                                     \
+	} while (0)
+
+// GPU time of a frame whose full-resolution GPU time is 'load' times the budget, at the governor's current scale.
+
+static uint64_t gpu_time(res_gov_t const* gov, float load) {
+	return load * BUDGET * gov->scale * gov->scale;
+}
+
+// Feed 'count' frames of a given load and return the last scale.
+
+static float run(res_gov_t* gov, float load, size_t count) {
+	float scale = gov->scale;
+
+	for (size_t i = 0; i < count; i++) {
+		scale = res_gov_update(gov, gpu_time(gov, load), BUDGET);
+	}
+
+	return scale;
+}
+
+// With plenty of headroom, we stay at full resolution.
+
+static void test_headroom(void) {
+	res_gov_t gov;
+	res_gov_init(&gov);
+
+	float const scale = run(&gov, 0.5, 1000);
+	CHECK(scale == RES_GOV_MAX_SCALE, "Scale dropped to %f with headroom.", scale);
+}
+
+// Going over budget drops the scale straight away, by as much as is needed to get back to the target in one go.
+// The scale then holds for the cooldown, even though the average hasn't caught up yet.
+
+static void test_drop(void) {
+	res_gov_t gov;
+	res_gov_init(&gov);
+
+	float const scale = res_gov_update(&gov, 1.2 * BUDGET, BUDGET);
+	float const expected = sqrt(RES_GOV_TARGET / 1.2);
+
+	CHECK(fabs(scale - expected) < 1e-3, "Dropped to %f rather than %f.", scale, expected);
+
+	for (size_t i = 0; i < RES_GOV_COOLDOWN; i++) {
+		float const held = res_gov_update(&gov, 1.2 * BUDGET, BUDGET);
+		CHECK(held == scale, "Scale changed to %f during cooldown (sample %zu).", held, i);
+	}
+}
+
+// Under a constant load, the scale settles between the thresholds rather than oscillating.
+
+static void test_settle(void) {
+	res_gov_t gov;
+	res_gov_init(&gov);
+
+	run(&gov, 1.1, 1000);
+	float const settled = gov.scale;
+	float const load = 1.1 * settled * settled;
+
+	CHECK(load <= RES_GOV_HIGH && load >= RES_GOV_LOW, "Settled at a load of %f (scale %f).", load, settled);
+
+	for (size_t i = 0; i < 1000; i++) {
+		float const scale = res_gov_update(&gov, gpu_time(&gov, 1.1), BUDGET);
+		CHECK(scale == settled, "Scale oscillated from %f to %f.", settled, scale);
+
+		if (scale != settled) {
+			break;
+		}
+	}
+}
+
+// However heavy the load, the scale never goes under the minimum.
+
+static void test_min(void) {
+	res_gov_t gov;
+	res_gov_init(&gov);
+
+	float const scale = run(&gov, 10, 1000);
+	CHECK(scale == (float) RES_GOV_MIN_SCALE, "Scale went to %f under heavy load.", scale);
+}
+
+// Once the load goes away, the scale comes back up to full resolution one step per cooldown.
+
+static void test_recover(void) {
+	res_gov_t gov;
+	res_gov_init(&gov);
+
+	run(&gov, 10, 1000);
+
+	float prev = gov.scale;
+	size_t changes = 0;
+
+	for (size_t i = 0; i < 1000 && gov.scale < RES_GOV_MAX_SCALE; i++) {
+		float const scale = res_gov_update(&gov, gpu_time(&gov, 0.3), BUDGET);
+
+		if (scale == prev) {
+			continue;
+		}
+
+		CHECK(scale > prev, "Scale dropped from %f to %f while recovering.", prev, scale);
+		CHECK(scale - prev <= RES_GOV_STEP + 1e-6, "Scale jumped from %f to %f while recovering.", prev, scale);
+
+		prev = scale;
+		changes++;
+	}
+
+	CHECK(gov.scale == RES_GOV_MAX_SCALE, "Scale only recovered to %f.", gov.scale);
+	CHECK(changes >= (RES_GOV_MAX_SCALE - RES_GOV_MIN_SCALE) / RES_GOV_STEP - 1, "Recovered in only %zu steps.", changes);
+}
+
+int main(void) {
+	test_headroom();
+	test_drop();
+	test_settle();
+	test_min();
+	test_recover();
+
+	if (failures > 0) {
+		fprintf(stderr, "%d checks failed.\n", failures);
+		return 1;
+	}
+
+	return 0;
+}